@@ -45,36 +45,44 @@ void clipboard_set(struct range_tree* data, int binary, struct encoding* encodin
     external_encoding = encoding_utf8_static();
 #endif
     external_data = range_tree_create(NULL, 0);
-    range_tree_insert_split(external_data, 0, (const uint8_t*)binary_marker, strlen(binary_marker), 0);
-
-    char* buffer = NULL;
-    size_t pos = 0;
+    struct range_tree_build build;
+    range_tree_build_begin(&build, external_data);
+
+    // Collect as many lines as possible into one block, the marker starts the first block
+    char* buffer = (char*)malloc(sizeof(char)*(TREE_BLOCK_LENGTH_MIN+1));
+    size_t pos = strlen(binary_marker);
+    memcpy(buffer, binary_marker, pos);
+    size_t column = 0;
     struct stream stream;
     stream_from_page(&stream, range_tree_first(data), 0);
     while (1) {
       int end = stream_end(&stream);
-      if (pos==TIPPSE_BINARY_LINE_LENGTH*3 || end) {
-        if (pos>0) {
+      if (column==TIPPSE_BINARY_LINE_LENGTH || end) {
+        if (column>0) {
           buffer[pos-1] = '\n';
+        }
+
+        column = 0;
+        if (end || pos+TIPPSE_BINARY_LINE_LENGTH*3>TREE_BLOCK_LENGTH_MIN) {
           struct fragment* fragment = fragment_create_memory((uint8_t*)buffer, pos);
-          range_tree_insert(external_data, range_tree_length(external_data), fragment, 0, pos, 0, 0, NULL);
+          range_tree_build_append(&build, fragment, 0, pos, 0, 0, NULL);
           fragment_dereference(fragment, NULL);
-        }
 
-        if (end) {
-          break;
-        }
-        pos = 0;
-      }
+          if (end) {
+            break;
+          }
 
-      if (pos==0) {
-        buffer = (char*)malloc(sizeof(char)*TIPPSE_BINARY_LINE_LENGTH*3);
+          buffer = (char*)malloc(sizeof(char)*(TREE_BLOCK_LENGTH_MIN+1));
+          pos = 0;
+        }
       }
 
       sprintf(&buffer[pos], "%02x ", stream_read_forward(&stream));
       pos+=3;
+      column++;
     }
     stream_destroy(&stream);
+    range_tree_build_end(&build);
   }
 
 #ifndef _TESTSUITE
@@ -192,13 +200,17 @@ struct range_tree* clipboard_get(struct encoding** encoding, int* binary) {
       *binary = 1;
       pos = 0;
       struct range_tree* external_data = range_tree_create(NULL, 0);
+      struct range_tree_build build;
+      range_tree_build_begin(&build, external_data);
       uint8_t* buffer = NULL;
       while (1) {
         int end = stream_end(&stream);
         if (end || pos==TREE_BLOCK_LENGTH_MIN) {
-          struct fragment* fragment = fragment_create_memory((uint8_t*)buffer, pos);
-          range_tree_insert(external_data, range_tree_length(external_data), fragment, 0, pos, 0, 0, NULL);
-          fragment_dereference(fragment, NULL);
+          if (pos>0) {
+            struct fragment* fragment = fragment_create_memory((uint8_t*)buffer, pos);
+            range_tree_build_append(&build, fragment, 0, pos, 0, 0, NULL);
+            fragment_dereference(fragment, NULL);
+          }
 
           if (end) {
             break;
@@ -219,6 +231,7 @@ struct range_tree* clipboard_get(struct encoding** encoding, int* binary) {
         pos++;
       }
 
+      range_tree_build_end(&build);
       stream_destroy(&stream);
       range_tree_destroy(data);
       data = external_data;
@@ -274,18 +287,20 @@ struct range_tree* clipboard_command_get(struct encoding** encoding, const char*
   FILE* pipe = popen(command, "r");
   if (pipe) {
     data = range_tree_create(NULL, 0);
+    struct range_tree_build build;
+    range_tree_build_begin(&build, data);
     while (!feof(pipe)) {
       uint8_t* buffer = (uint8_t*)malloc(TREE_BLOCK_LENGTH_MIN);
       file_offset_t length = fread(buffer, 1, TREE_BLOCK_LENGTH_MIN, pipe);
       if (length) {
-        file_offset_t offset = range_tree_length(data);
         struct fragment* fragment = fragment_create_memory(buffer, length);
-        range_tree_insert(data, offset, fragment, 0, length, 0, 0, NULL);
+        range_tree_build_append(&build, fragment, 0, length, 0, 0, NULL);
         fragment_dereference(fragment, NULL);
       } else {
         free(buffer);
       }
     }
+    range_tree_build_end(&build);
 
     int result = pclose(pipe);
     if (result!=0) {
@@ -4,9 +4,11 @@
 
 #include "clipboard.h"
 #include "config.h"
+#include "library/count.h"
 #include "library/directory.h"
 #include "document_text.h"
 #include "documentfile.h"
+#include "documenttransaction.h"
 #include "documentundo.h"
 #include "documentview.h"
 #include "editor.h"
@@ -44,6 +46,10 @@ int document_search(struct document_file* file, struct document_view* view, stru
     return 0;
   }
 
+  if (replace && all) {
+    return document_search_replace_all(file, view, search_text, search_encoding, replace_text, replace_encoding, ignore_case, regex);
+  }
+
   struct search* search = document_search_build(file, search_text, search_encoding, reverse, ignore_case, regex);
 
   if (!replace && all) {
@@ -140,7 +146,7 @@ int document_search(struct document_file* file, struct document_view* view, stru
     }
 
     file_offset_t displacement;
-    struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, offset, &displacement);
+    struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, offset, &displacement);
     struct stream text_stream;
     stream_from_page(&text_stream, buffer, displacement);
 
@@ -250,6 +256,116 @@ int document_search(struct document_file* file, struct document_view* view, stru
   return 0;
 }
 
+// Replace all matches, the matches are collected on the unchanged document and applied as one transaction
+int document_search_replace_all(struct document_file* file, struct document_view* view, struct range_tree* search_text, struct encoding* search_encoding, struct range_tree* replace_text, struct encoding* replace_encoding, int ignore_case, int regex) {
+  struct search* search = document_search_build(file, search_text, search_encoding, 0, ignore_case, regex);
+
+  uint8_t* replacement_text = NULL;
+  size_t replacement_length = 0;
+  if (!regex && replace_text) {
+    struct range_tree* replacement = replace_text;
+    if (file->encoding!=replace_encoding) {
+      replacement = encoding_transform_page(replace_text->root, 0, FILE_OFFSET_T_MAX, replace_encoding, file->encoding);
+    }
+
+    // An empty replacement has no pages to transform
+    if (replacement) {
+      replacement_length = (size_t)range_tree_length(replacement);
+      replacement_text = range_tree_raw(replacement, 0, replacement_length);
+      if (replacement!=replace_text) {
+        range_tree_destroy(replacement);
+      }
+    }
+  }
+
+  file_offset_t length = range_tree_length(&file->buffer);
+  file_offset_t selection_low;
+  file_offset_t selection_high;
+  document_view_select_next(view, 0, &selection_low, &selection_high);
+  file_offset_t begin = (selection_low!=FILE_OFFSET_T_MAX)?selection_low:view->offset;
+  if (begin>length) {
+    begin = length;
+  }
+
+  struct document_transaction transaction;
+  document_transaction_create_inplace(&transaction, file);
+
+  file_offset_t replacements = 0;
+  file_offset_t last_offset = 0;
+  size_t last_length = 0;
+  for (int wrapped = 0; wrapped<2; wrapped++) {
+    file_offset_t offset = wrapped?0:begin;
+    file_offset_t stop = wrapped?begin:length;
+    while (offset<stop) {
+      file_offset_t displacement;
+      struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, offset, &displacement);
+      struct stream text_stream;
+      stream_from_page(&text_stream, buffer, displacement);
+
+      file_offset_t left = stop-offset;
+      file_offset_t start = 0;
+      file_offset_t end = 0;
+      int found = 0;
+      while (search_find(search, &text_stream, &left, NULL)) {
+        start = stream_offset_page(&search->hit_start);
+        end = stream_offset_page(&search->hit_end);
+        if (start>=offset) {
+          // Matches of the wrapped pass must end before the first pass started
+          found = (!wrapped || end<=begin)?1:0;
+          break;
+        }
+      }
+      stream_destroy(&text_stream);
+
+      if (!found) {
+        break;
+      }
+
+      if (regex) {
+        struct range_tree* replacement = search_replacement(search, replace_text, replace_encoding, &file->buffer);
+        if (replacement) {
+          last_length = (size_t)range_tree_length(replacement);
+          document_transaction_replace_buffer(&transaction, start, end-start, replacement);
+          range_tree_destroy(replacement);
+        } else {
+          last_length = 0;
+          document_transaction_replace(&transaction, start, end-start, NULL, 0);
+        }
+      } else {
+        last_length = replacement_length;
+        document_transaction_replace(&transaction, start, end-start, replacement_text, replacement_length);
+      }
+
+      replacements++;
+      last_offset = start;
+      offset = (end>start)?end:end+1;
+    }
+  }
+
+  search_destroy(search);
+  free(replacement_text);
+
+  if (replacements>0) {
+    // The last replacement stays selected, position is taken behind its new text
+    document_transaction_relocate(&transaction, &last_offset);
+    last_offset = (last_offset>last_length)?last_offset-last_length:0;
+    if (document_transaction_commit(&transaction)) {
+      document_view_select_nothing(view, file, 0);
+      document_view_select_range(view, last_offset, last_offset+last_length, TIPPSE_INSERTER_MARK|TIPPSE_INSERTER_NOFUSE, 0);
+      view->offset = last_offset+last_length;
+    } else {
+      replacements = 0;
+    }
+  }
+
+  document_transaction_destroy_inplace(&transaction);
+
+  char status[1024];
+  sprintf(&status[0], "%d replacement(s)", (int)replacements);
+  editor_console_update(file->editor, &status[0], SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
+  return 1;
+}
+
 // Search in directory
 void document_search_directory(struct thread* thread, struct document_file* pipe, const char* path, struct range_tree* search_text, struct encoding* search_encoding, struct range_tree* replace_text, struct encoding* replace_encoding, int ignore_case, int regex, int replace, const char* pattern_text, struct encoding* pattern_encoding, int binary) {
   size_t length = strlen(path)+1024;
@@ -292,18 +408,18 @@ void document_search_directory(struct thread* thread, struct document_file* pipe
       if (search_find(pattern, &filename_stream, NULL, &thread->shutdown)) {
         struct document_file* file = document_file_create(0, 0, NULL);
         struct file_cache* cache = file_cache_create(scan);
+        // Scanned once, don't push pages of open documents out of the shared budget
+        cache->max = FILE_CACHE_SIZE;
         struct stream stream;
         stream_from_file(&stream, cache, 0);
         document_file_detect_properties_stream(file, &stream);
         if (!file->binary || binary) {
           struct search* search = document_search_build(file, search_text, search_encoding, 0, ignore_case, regex);
           file_offset_t line_previous = 0;
-          file_offset_t line = 1;
+          file_offset_t line_hit = 1;
+          file_offset_t line_offset = 0;
           struct stream newlines;
           stream_clone(&newlines, &stream);
-          file_offset_t line_hit = line;
-          struct stream line_start;
-          stream_clone(&line_start, &newlines);
           while (!stream_end(&stream) && !thread->shutdown) {
             int found = search_find(search, &stream, NULL, &thread->shutdown);
             if (!found) {
@@ -311,13 +427,31 @@ void document_search_directory(struct thread* thread, struct document_file* pipe
             }
             file_offset_t hit_start = stream_offset_file(&search->hit_start);
             file_offset_t hit_end = stream_offset_file(&search->hit_end);
-            while (stream_offset(&newlines)<=hit_start) {
-              line_hit = line;
-              stream_destroy(&line_start);
-              stream_clone(&line_start, &newlines);
-              while (!stream_end(&newlines) && stream_read_forward(&newlines)!='\n') {
+            // Count the lines in front of the hit page by page, the last newline starts the line of the hit
+            while (stream_offset(&newlines)<hit_start && !stream_end(&newlines)) {
+              size_t left = stream_cache_length(&newlines)-stream_displacement(&newlines);
+              if (left==0) {
+                stream_next(&newlines);
+                continue;
               }
-              line++;
+
+              if (left>hit_start-stream_offset(&newlines)) {
+                left = (size_t)(hit_start-stream_offset(&newlines));
+              }
+
+              const uint8_t* text = stream_buffer(&newlines);
+              size_t count = count_bytes(text, left, '\n');
+              if (count>0) {
+                line_hit += count;
+                size_t last = left;
+                while (text[last-1]!='\n') {
+                  last--;
+                }
+
+                line_offset = stream_offset(&newlines)+last;
+              }
+
+              stream_forward(&newlines, left);
             }
             hits++;
 
@@ -327,7 +461,7 @@ void document_search_directory(struct thread* thread, struct document_file* pipe
               int columns = 80;
               int max = 512;
               struct stream line_copy;
-              stream_clone(&line_copy, &line_start);
+              stream_from_file(&line_copy, cache, line_offset);
               while (!stream_end(&line_copy) && columns>0 && max>0) {
                 file_offset_t pos = stream_offset_file(&line_copy);
                 if (pos==hit_start) {
@@ -362,7 +496,6 @@ void document_search_directory(struct thread* thread, struct document_file* pipe
             }
           }
           stream_destroy(&newlines);
-          stream_destroy(&line_start);
 
           search_destroy(search);
         }
@@ -526,9 +659,12 @@ void document_clipboard_copy(struct document_file* file, struct document_view* v
   file_offset_t low;
   file_offset_t high = 0;
   struct range_tree* copy = range_tree_create(NULL, 0);
+  struct range_tree_build build;
+  range_tree_build_begin(&build, copy);
   while (document_view_select_next(view, high, &low, &high)) {
-    range_tree_node_copy_insert(file->buffer.root, low, copy, range_tree_length(copy), high-low);
+    range_tree_build_copy(&build, file->buffer.root, low, high-low);
   }
+  range_tree_build_end(&build);
   clipboard_set(copy, file->binary, file->encoding);
 }
 
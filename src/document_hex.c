@@ -112,7 +112,7 @@ void document_hex_draw(struct document* base, struct screen* screen, struct spli
 
   file_offset_t offset = (file_offset_t)(scroll_y*data_size);
   file_offset_t displacement;
-  struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, offset, &displacement);
+  struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, offset, &displacement);
   struct stream byte_stream;
   stream_from_page(&byte_stream, buffer, displacement);
 
@@ -122,10 +122,10 @@ void document_hex_draw(struct document* base, struct screen* screen, struct spli
   unicode_sequencer_clear(&text_sequence, file->encoding, &text_stream);
 
   file_offset_t selection_displacement;
-  struct range_tree_node* selection = range_tree_node_find_offset(view->selection.root, offset, &selection_displacement);
+  struct range_tree_node* selection = range_tree_find_offset(&view->selection, offset, &selection_displacement);
 
   file_offset_t bookmark_displacement;
-  struct range_tree_node* bookmark = range_tree_node_find_offset(file->bookmarks.root, offset, &bookmark_displacement);
+  struct range_tree_node* bookmark = range_tree_find_offset(&file->bookmarks, offset, &bookmark_displacement);
 
   splitter_name(splitter, file->filename);
 
@@ -4,14 +4,18 @@
 
 #include "clipboard.h"
 #include "config.h"
+#include "library/count.h"
 #include "document.h"
 #include "documentfile.h"
+#include "documenttransaction.h"
 #include "documentundo.h"
 #include "documentview.h"
 #include "editor.h"
 #include "library/encoding.h"
 #include "library/encoding/utf8.h"
 #include "filetype.h"
+#include "filetype/text.h"
+#include "library/atomic.h"
 #include "library/fragment.h"
 #include "library/misc.h"
 #include "library/rangetree.h"
@@ -39,6 +43,8 @@ int debug_chars = 0;
 struct screen* debug_screen = NULL;
 struct splitter* debug_splitter = NULL;
 
+int document_text_ascii_path = 1;
+
 extern struct trie* unicode_transform_lower;
 extern struct trie* unicode_transform_upper;
 extern struct trie* unicode_transform_nfd_nfc;
@@ -289,7 +295,7 @@ void document_text_render_seek(struct document_text_render_info* render_info, st
       render_info->keyword_color = visuals->keyword_color;
       render_info->keyword_length = visuals->keyword_length;
       render_info->spell_length = visuals->spell_length;
-      render_info->selection = range_tree_node_find_offset(render_info->selection_tree->root, render_info->offset, &render_info->selection_displacement);
+      render_info->selection = range_tree_find_offset(render_info->selection_tree, render_info->offset, &render_info->selection_displacement);
       for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
         render_info->depth_new[n] = visual_info_find_bracket(view, buffer_new, buffer, n);
         render_info->depth_old[n] = render_info->depth_new[n];
@@ -393,6 +399,7 @@ int document_text_split_buffer(struct range_tree_node* buffer, struct document_f
     return 0;
   }
 
+  document_file_save_settle(file);
   struct range_tree_node* after = buffer;
   range_tree_split(&file->buffer, &after, TREE_BLOCK_LENGTH_MIN, 0);
   return 1;
@@ -574,6 +581,261 @@ void document_text_update_brackets(struct document_text_render_info* render_info
   }
 }
 
+// Check once if the page contains printable ASCII, tabs and line feeds only, the result stays cached until the page is invalidated
+bool_t document_text_ascii_page(struct visual_info* visuals, struct range_tree_node* buffer) {
+  if (visuals->ascii==VISUAL_ASCII_UNKNOWN) {
+    visuals->ascii = VISUAL_ASCII_YES;
+    file_offset_t displacement = 0;
+    while (displacement<buffer->length) {
+      struct stream stream;
+      stream_from_page(&stream, buffer, displacement);
+      size_t length = stream_cache_length(&stream)-stream_displacement(&stream);
+      if (length==0 || count_printable(stream_buffer(&stream), length)!=length) {
+        visuals->ascii = VISUAL_ASCII_NO;
+      }
+
+      stream_destroy(&stream);
+      if (visuals->ascii==VISUAL_ASCII_NO) {
+        break;
+      }
+
+      displacement += length;
+    }
+  }
+
+  return (visuals->ascii==VISUAL_ASCII_YES)?1:0;
+}
+
+// Width of a printable ASCII character, tab or line feed
+TIPPSE_INLINE int document_text_ascii_fill(position_t x, int tabstop_width, uint8_t c) {
+  return (c=='\t')?tabstop_width-(int)(x%tabstop_width):1;
+}
+
+// Layout printable ASCII characters directly from the page bytes, returns the number of characters done
+// Gives the same results as the sequencer loop with the plain text type, the span ends before its last whitespace so that the next character and the word wrap lookahead are always inside
+size_t document_text_collect_ascii(struct document_text_render_info* render_info, const struct document_text_position* in, const uint8_t* text, size_t length, bool_t wrapping, int tabstop_width, bool_t* indented, bool_t* bracketed_line, int* fill) {
+  size_t end = length;
+  while (end>0 && text[end-1]>' ') {
+    end--;
+  }
+
+  if (end==0) {
+    return 0;
+  }
+
+  end--;
+  if (in->type==VISUAL_SEEK_OFFSET) {
+    if (render_info->offset>=in->offset) {
+      return 0;
+    }
+
+    if (end>in->offset-render_info->offset) {
+      end = (size_t)(in->offset-render_info->offset);
+    }
+  } else if ((in->type==VISUAL_SEEK_X_Y && render_info->y_view>=in->y) || (in->type==VISUAL_SEEK_LINE_COLUMN && render_info->line>=in->line)) {
+    return 0;
+  }
+
+  // Keep the per character state local, the render info is only touched at line ends and brackets
+  int visual_detail = render_info->visual_detail;
+  position_t width = render_info->width;
+  position_t x = render_info->x;
+  position_t xs = render_info->xs;
+  position_t column = render_info->column;
+  position_t columns = render_info->columns;
+  long indentation = render_info->indentation;
+  long indentations = render_info->indentations;
+  bool_t indented_line = *indented;
+  int current = *fill;
+  size_t pos = 0;
+  while (pos<end) {
+    // Inside of a line the characters without brackets just advance the position as long as the next one isn't a tab or causes a wrap
+    if (!indented_line && (visual_detail&(VISUAL_DETAIL_STOPPED_INDENTATION|VISUAL_DETAIL_NEWLINE))==VISUAL_DETAIL_STOPPED_INDENTATION) {
+      size_t limit = end;
+      if (wrapping) {
+        limit = (x+1<width)?pos+(size_t)(width-x-1):pos;
+        if (limit>end) {
+          limit = end;
+        }
+      }
+
+      size_t run = pos;
+      while (run<limit) {
+        uint8_t c = text[run];
+        if (c<' ' || unicode_bracket(c) || text[run+1]=='\t') {
+          break;
+        }
+
+        // A space stays in the run if the following word fits into the row
+        if (wrapping && c==' ' && text[run+1]>' ') {
+          position_t max = width-indentation-tabstop_width+1;
+          position_t word = 1;
+          size_t advance = run+2;
+          while (word<max && text[advance]>' ') {
+            word++;
+            advance++;
+          }
+
+          if (word<max && x+(position_t)(run-pos)+1+word>width) {
+            break;
+          }
+        }
+
+        run++;
+      }
+
+      if (run>pos) {
+        uint8_t c = text[run-1];
+        visual_detail &= ~(VISUAL_DETAIL_CONTROLCHARACTER|VISUAL_DETAIL_INDENTATION|VISUAL_DETAIL_WORD);
+        if (c==' ') {
+          visual_detail |= VISUAL_DETAIL_INDENTATION;
+        } else if (unicode_word(c)) {
+          visual_detail |= VISUAL_DETAIL_WORD;
+        }
+
+        x += (position_t)(run-pos);
+        xs += (position_t)(run-pos);
+        column += (position_t)(run-pos);
+        columns += (position_t)(run-pos);
+        pos = run;
+        if (pos>=end) {
+          break;
+        }
+      }
+    }
+
+    uint8_t c = text[pos];
+    visual_detail &= ~(VISUAL_DETAIL_CONTROLCHARACTER|VISUAL_DETAIL_INDENTATION|VISUAL_DETAIL_WORD);
+    if (c=='\t' || c==' ') {
+      visual_detail |= VISUAL_DETAIL_INDENTATION;
+    } else if (unicode_word(c)) {
+      visual_detail |= VISUAL_DETAIL_WORD;
+    }
+
+    int bracket_match = (visual_detail&(VISUAL_DETAIL_STRING0|VISUAL_DETAIL_STRING1|VISUAL_DETAIL_COMMENT0|VISUAL_DETAIL_COMMENT1))?0:unicode_bracket(c);
+
+    if (visual_detail&VISUAL_DETAIL_NEWLINE) {
+      visual_detail &= ~VISUAL_DETAIL_NEWLINE;
+      indented_line = 1;
+    }
+
+    if (!(visual_detail&VISUAL_DETAIL_INDENTATION)) {
+      visual_detail |= VISUAL_DETAIL_STOPPED_INDENTATION;
+      indented_line = 0;
+    }
+
+    if (indented_line && indentation<width/2) {
+      indentation += current;
+      indentations += current;
+    } else {
+      xs += current;
+    }
+
+    x += current;
+    column++;
+    columns++;
+    pos++;
+
+    uint8_t next = text[pos];
+    int width0 = current = document_text_ascii_fill(x, tabstop_width, next);
+    if (wrapping && c<=' ' && next>' ') {
+      position_t max = width-indentation-tabstop_width+1;
+      size_t advance = pos+1;
+      while (width0<max && text[advance]>' ') {
+        width0++;
+        advance++;
+      }
+
+      if (width0>=max) {
+        width0 = current;
+      }
+    }
+
+    if (c=='\n' || (wrapping && x+(width0?width0:1)>width)) {
+      if (c=='\n') {
+        indentations = 0;
+        render_info->indentations_extra = 0;
+        indentation = 0;
+        render_info->indentation_extra = 0;
+
+        if (visual_detail&VISUAL_DETAIL_WHITESPACED_COMPLETE) {
+          visual_detail |= VISUAL_DETAIL_WHITESPACED_START;
+        }
+
+        visual_detail |= VISUAL_DETAIL_NEWLINE;
+        visual_detail &= ~(VISUAL_DETAIL_WRAPPED|VISUAL_DETAIL_STOPPED_INDENTATION);
+
+        indented_line = 0;
+
+        render_info->line++;
+        render_info->lines++;
+        column = 0;
+        columns = 0;
+
+        if (*bracketed_line) {
+          *bracketed_line = 0;
+          for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+            render_info->brackets_line[n].diff = 0;
+            render_info->brackets_line[n].min = 0;
+            render_info->brackets_line[n].max = 0;
+            render_info->depth_line[n] = render_info->depth_new[n];
+          }
+        }
+      } else {
+        if (render_info->indentation_extra==0) {
+          render_info->indentations_extra = tabstop_width;
+          render_info->indentation_extra = tabstop_width;
+        }
+
+        visual_detail |= VISUAL_DETAIL_WRAPPED;
+      }
+
+      render_info->ys++;
+      render_info->y_view++;
+      x = indentation+render_info->indentation_extra;
+      xs = 0;
+
+      current = document_text_ascii_fill(x, tabstop_width, next);
+
+      // Characters on the target row or line have to pass the position checks of the caller
+      if ((in->type==VISUAL_SEEK_X_Y && render_info->y_view>=in->y) || (in->type==VISUAL_SEEK_LINE_COLUMN && render_info->line>=in->line)) {
+        end = pos;
+      }
+    }
+
+    if (c!='\t' && c!=' ') {
+      visual_detail &= ~VISUAL_DETAIL_WHITESPACED_COMPLETE;
+    }
+
+    if (bracket_match) {
+      *bracketed_line = 1;
+      document_text_update_brackets(render_info, bracket_match);
+    }
+  }
+
+  render_info->visual_detail = visual_detail;
+  render_info->x = x;
+  render_info->xs = xs;
+  render_info->column = column;
+  render_info->columns = columns;
+  render_info->indentation = indentation;
+  render_info->indentations = indentations;
+  render_info->displacement += pos;
+  render_info->offset += pos;
+  render_info->selection_displacement += pos;
+  render_info->keyword_length -= (long)pos;
+  render_info->spell_length -= (long)pos;
+  render_info->character += pos;
+  render_info->characters += pos;
+  if (pos>0) {
+    render_info->offset_sync = render_info->offset;
+  }
+
+  *indented = indented_line;
+  *fill = current;
+  return pos;
+}
+
 // Render some pages until the position is found or pages are no longer dirty
 // TODO: find better visualization for debugging, find unnecessary render iterations and then optimize (as soon the code is "feature complete")
 int document_text_collect_span_base(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, const struct document_text_position* in, struct document_text_position* out, int dirty_pages, int cancel) {
@@ -617,7 +879,10 @@ int document_text_collect_span_base(struct document_text_render_info* render_inf
   codepoint_t newline_cp2 = (file->newline==TIPPSE_NEWLINE_CRLF)?'\r':UNICODE_CODEPOINT_UNASSIGNED;
   codepoint_t newline_cp3 = (file->newline!=TIPPSE_NEWLINE_CRLF)?UNICODE_CODEPOINT_UNASSIGNED:newline_cp1;
   codepoint_t newline_cp4 = (file->newline==TIPPSE_NEWLINE_CR)?'\n':'\r';
-  debug_pages_collect++;
+  // Layout workers collect on shadow documents without editor, the debug counters belong to the main thread
+  if (file->editor) {
+    debug_pages_collect++;
+  }
 
   void (*mark)(struct document_text_render_info* render_info, struct unicode_sequencer* sequencer, struct unicode_sequence* sequence) = file->type->mark;
   int (*match)(const struct document_text_render_info* render_info, struct unicode_sequence* sequence) = file->type->bracket_match;
@@ -644,6 +909,10 @@ int document_text_collect_span_base(struct document_text_render_info* render_inf
   struct unicode_sequence* sequence = unicode_sequencer_find(&sequencer, 0);
   int fill = document_text_fill_width_fillonly(render_info->x, show_invisibles, tabstop_width, sequence, newline_cp1, newline_cp2, file->newline);
 
+  // Plain text in encodings that keep ASCII as single bytes can be laid out without decoding as long as no seek target is crossed
+  bool_t ascii = (document_text_ascii_path && mark==file_type_text_mark && match==file_type_bracket_match && !spellcheck && (file->newline==TIPPSE_NEWLINE_AUTO || file->newline==TIPPSE_NEWLINE_LF) && document_file_summary_encoding(file->encoding)!=TIPPSE_DOCUMENT_SUMMARY_NONE && (in->type==VISUAL_SEEK_OFFSET || in->type==VISUAL_SEEK_X_Y || in->type==VISUAL_SEEK_LINE_COLUMN))?1:0;
+  bool_t ascii_page = ascii;
+
   while (1) {
     bool_t boundary = 0;
     while (render_info->buffer && UNLIKELY(render_info->displacement>=render_info->buffer->length)) {
@@ -699,6 +968,7 @@ int document_text_collect_span_base(struct document_text_render_info* render_inf
           visuals->displacement = render_info->displacement;
           visuals->rewind = rewind;
           visuals->dirty |= VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+          visuals->ascii = VISUAL_ASCII_UNKNOWN;
           range_tree_node_update_calc_all(render_info->buffer, render_info->buffer_tree);
         }
 
@@ -742,10 +1012,28 @@ int document_text_collect_span_base(struct document_text_render_info* render_inf
       bracketed_line = 0;
 
       page_dirty = (render_info->buffer && visuals->dirty)?1:0;
-      debug_pages_collect++;
+      ascii_page = ascii;
+      if (file->editor) {
+        debug_pages_collect++;
+        if ((debug_pages_collect&255)==0) {
+          editor_process_message(file->editor, "Locating...", render_info->offset, range_tree_length(&file->buffer));
+        }
+      }
+    }
+
+    // The first character of a page still passes the stop checks below
+    if (ascii_page && !boundary && !stop && render_info->buffer && render_info->keyword_length<=0) {
+      ascii_page = 0;
+      if (document_text_ascii_page(visuals, render_info->buffer)) {
+        stream_destroy(&stream);
+        stream_from_page(&stream, render_info->buffer, render_info->displacement);
+        if (document_text_collect_ascii(render_info, in, stream_buffer(&stream), stream_cache_length(&stream)-stream_displacement(&stream), wrapping, tabstop_width, &indented, &bracketed_line, &fill)>0) {
+          stream_destroy(&stream);
+          stream_from_page(&stream, render_info->buffer, render_info->displacement);
+        }
 
-      if ((debug_pages_collect&255)==0) {
-        editor_process_message(file->editor, "Locating...", render_info->offset, range_tree_length(&file->buffer));
+        unicode_sequencer_clear(&sequencer, file->encoding, &stream);
+        sequence = unicode_sequencer_find(&sequencer, 0);
       }
     }
 
@@ -1385,9 +1673,482 @@ int document_text_render_span(struct document_text_render_info* render_info, str
   return rendered;
 }
 
+// Hand dirty pages to layout workers and merge their result when done, returns 0 if the caller has to lay out the view itself
+int document_text_layout_update(struct document_view* view, struct document_file* file) {
+  if (!TIPPSE_DOCUMENT_SAVE_THREAD || !file->editor || !file->buffer.root || view->spellcheck) {
+    document_text_layout_cancel(view);
+    return 0;
+  }
+
+  if (!view->layout) {
+    struct document_text_layout* layout = (struct document_text_layout*)malloc(sizeof(struct document_text_layout));
+    layout->file = file;
+    layout->editor = file->editor;
+    layout->segments = NULL;
+    layout->count = 0;
+    layout->processors = thread_processors();
+    layout->pages = TIPPSE_LAYOUT_PAGES_MIN;
+    layout->view_offset = view->offset;
+    view->layout = layout;
+  }
+
+  struct document_text_layout* layout = view->layout;
+  if (layout->file!=file) {
+    document_text_layout_cancel(view);
+    layout->file = file;
+    layout->editor = file->editor;
+  }
+
+  if (layout->count) {
+    if (!atomic_acquire_fileoffset_t(&layout->done)) {
+      return 1;
+    }
+
+    if (!document_text_layout_merge(view, file)) {
+      return 0;
+    }
+  }
+
+  struct visual_info* visuals = document_view_visual_create(view, file->buffer.root, &file->buffer);
+  if (!visuals->dirty) {
+    return 1;
+  }
+
+  return document_text_layout_begin(view, file);
+}
+
+// Renderer state at the start of the page containing the offset or of the first dirty page before
+void document_text_layout_seek(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, file_offset_t offset) {
+  struct document_text_position in;
+  in.type = VISUAL_SEEK_OFFSET;
+  in.offset = offset;
+  in.clip = 0;
+
+  document_text_render_clear(render_info, document_text_line_width(view, file), &view->selection);
+  document_text_render_seek(render_info, view, &file->buffer, file->encoding, &in);
+}
+
+// Compare renderer state at the start of a page
+int document_text_layout_same(const struct document_text_render_info* left, const struct document_text_render_info* right) {
+  if (left->buffer!=right->buffer || left->width!=right->width || left->visual_detail!=right->visual_detail || left->offset!=right->offset || left->offset_sync!=right->offset_sync || left->displacement!=right->displacement || left->x!=right->x || left->y_view!=right->y_view || left->line!=right->line || left->column!=right->column || left->character!=right->character || left->indentation!=right->indentation || left->indentation_extra!=right->indentation_extra || left->indented!=right->indented || left->keyword_color!=right->keyword_color || left->keyword_length!=right->keyword_length || left->spell_length!=right->spell_length) {
+    return 0;
+  }
+
+  for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+    if (left->depth_new[n]!=right->depth_new[n]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Compare the renderer state that influences the layout of the following pages, lines and characters only count on
+int document_text_layout_continues(const struct document_text_render_info* left, const struct document_text_render_info* right) {
+  if (left->visual_detail!=right->visual_detail || left->offset!=right->offset || left->offset_sync!=right->offset_sync || left->displacement!=right->displacement || left->x!=right->x || left->indentation!=right->indentation || left->indentation_extra!=right->indentation_extra || left->indented!=right->indented || left->keyword_color!=right->keyword_color || left->keyword_length!=right->keyword_length || left->spell_length!=right->spell_length) {
+    return 0;
+  }
+
+  for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+    if (left->depth_new[n]!=right->depth_new[n]) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// Copy the pages from the first dirty one on and start workers laying them out, returns 0 if there is nothing to copy
+int document_text_layout_begin(struct document_view* view, struct document_file* file) {
+  struct document_text_layout* layout = view->layout;
+  struct document_text_render_info render_info;
+  document_text_layout_seek(&render_info, view, file, range_tree_length(&file->buffer));
+  struct range_tree_node* first = render_info.buffer;
+  document_text_render_destroy(&render_info);
+  if (!first) {
+    return 0;
+  }
+
+  layout->offset = range_tree_node_offset(first);
+  document_text_layout_seek(&render_info, view, file, layout->offset);
+  if (render_info.buffer!=first) {
+    document_text_render_destroy(&render_info);
+    return 0;
+  }
+
+  // Windows next to the viewport are small to show the result soon, the following ones grow to keep the worker busy
+  if (layout->view_offset!=view->offset) {
+    layout->view_offset = view->offset;
+    layout->pages = TIPPSE_LAYOUT_PAGES_MIN;
+  }
+
+  // Pages are split in the document before they are copied, the worker must not split them since that creates fragments
+  size_t pages = 0;
+  struct range_tree_node* node = first;
+  while (node && pages<layout->pages) {
+    document_text_split_buffer(node, file);
+    node = range_tree_node_next(node);
+    pages++;
+  }
+
+  if (node) {
+    document_text_split_buffer(node, file);
+  }
+
+  // Grown windows are cut into segments for parallel workers, only the first one starts with the state of the document
+  size_t count = pages/TIPPSE_LAYOUT_PAGES_MIN;
+  if (count>(size_t)layout->processors) {
+    count = (size_t)layout->processors;
+  }
+
+  if (count>TIPPSE_LAYOUT_SEGMENTS) {
+    count = TIPPSE_LAYOUT_SEGMENTS;
+  }
+
+  if (count<1) {
+    count = 1;
+  }
+
+  layout->uid = view->uid;
+  layout->last = NULL;
+  layout->valid = 0;
+  layout->done = 0;
+  layout->cancel = 0;
+  layout->segments = (struct document_text_layout_segment*)malloc(sizeof(struct document_text_layout_segment)*count);
+
+  node = first;
+  file_offset_t offset = layout->offset;
+  for (size_t index = 0; index<count; index++) {
+    struct document_text_layout_segment* segment = &layout->segments[index];
+    segment->layout = layout;
+    segment->offset = offset;
+    segment->pages = (index==count-1)?pages-(pages/count)*(count-1):pages/count;
+    segment->reached = 0;
+    segment->render_info = render_info;
+    if (index>0) {
+      document_text_layout_guess(&segment->render_info, view, file, node, offset);
+    }
+
+    struct range_tree_node* start = node;
+    file_offset_t window = 0;
+    for (size_t page = 0; page<segment->pages; page++) {
+      window += node->length;
+      node = range_tree_node_next(node);
+    }
+
+    // The page behind the segment receives the state at its start
+    file_offset_t length = window+TIPPSE_LAYOUT_LOOKAHEAD;
+    size_t seeded = segment->pages;
+    if (node) {
+      length += node->length;
+      seeded++;
+    }
+
+    file_offset_t rest = range_tree_length(&file->buffer)-offset;
+    if (length>=rest) {
+      length = rest;
+    }
+
+    layout->complete = (length==rest)?1:0;
+    segment->end = offset+window;
+    segment->view = document_view_create();
+    segment->view->wrapping = view->wrapping;
+    segment->view->show_invisibles = view->show_invisibles;
+    segment->view->spellcheck = 0;
+    segment->shadow = document_file_create_shadow(file, segment->view, offset, length);
+
+    // The copy starts with the layout of the document, the worker stops like the foreground layout as soon as old and new state agree
+    // The old layout doesn't belong to a guessed state, those segments are laid out completely
+    struct range_tree_node* copy = range_tree_first(&segment->shadow->buffer);
+    for (size_t page = 0; page<seeded; page++) {
+      struct visual_info* visuals = document_view_visual_create(segment->view, copy, &segment->shadow->buffer);
+      *visuals = *document_view_visual_create(view, start, &file->buffer);
+      if (index>0 && page<segment->pages) {
+        visuals->dirty |= VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+        visuals->ascii = VISUAL_ASCII_UNKNOWN;
+      }
+
+      start = range_tree_node_next(start);
+      copy = range_tree_node_next(copy);
+    }
+
+    offset = segment->end;
+  }
+
+  // The first worker joins the others, they have to exist before
+  layout->count = count;
+  for (size_t index = 1; index<count; index++) {
+    thread_create_inplace(&layout->segments[index].thread, document_text_layout_speculate, &layout->segments[index]);
+  }
+
+  thread_create_inplace(&layout->thread, document_text_layout_entry, layout);
+
+  return 1;
+}
+
+// Guess the state at the start of a page from its last layout, the page is assumed to start at the beginning of a screen row
+void document_text_layout_guess(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, struct range_tree_node* buffer, file_offset_t offset) {
+  render_info->buffer_tree = &file->buffer;
+  render_info->buffer = buffer;
+  document_text_layout_resume(render_info, view);
+
+  struct visual_info* visuals = document_view_visual_create(view, buffer, &file->buffer);
+  render_info->displacement = visuals->displacement;
+  render_info->offset = offset+visuals->displacement;
+  render_info->offset_sync = offset-visuals->rewind;
+  render_info->x = 0;
+  render_info->indentation = 0;
+  render_info->indentation_extra = 0;
+  render_info->indented = 0;
+  render_info->bracketed_line = 0;
+}
+
+// Continue the layout at the first page in the copy of a segment
+void document_text_layout_bind(struct document_text_render_info* render_info, struct document_text_layout_segment* segment) {
+  render_info->buffer_tree = &segment->shadow->buffer;
+  render_info->buffer = range_tree_first(&segment->shadow->buffer);
+  render_info->selection_tree = NULL;
+  render_info->selection = NULL;
+}
+
+// Lay out the copy of a segment chunk by chunk, returns 1 if the end was reached, 2 if the layout converged to the one of the copy and 0 if it stopped otherwise
+int document_text_layout_run(struct document_text_render_info* render_info, struct document_text_layout_segment* segment) {
+  struct document_text_position in;
+  in.type = VISUAL_SEEK_OFFSET;
+  in.offset = segment->end;
+  in.clip = 0;
+
+  while (!atomic_get_fileoffset_t(&segment->layout->cancel)) {
+    file_offset_t offset = render_info->offset;
+    document_text_collect_span(render_info, segment->view, segment->shadow, &in, NULL, TIPPSE_LAYOUT_CHUNK, 1);
+    if (!render_info->buffer) {
+      return 1;
+    }
+
+    if (render_info->offset>=segment->end) {
+      document_text_layout_resume(render_info, segment->view);
+      return 1;
+    }
+
+    if (render_info->offset==offset) {
+      break;
+    }
+
+    // A clean page to stop at means that old and new state agree
+    struct visual_info* visuals = document_view_visual_create(segment->view, render_info->buffer, render_info->buffer_tree);
+    if (!visuals->dirty) {
+      return 2;
+    }
+
+    document_text_layout_resume(render_info, segment->view);
+  }
+
+  return 0;
+}
+
+// Worker laying out the first segment and taking over the guessed segments behind it, the file type is shared with the document and only read
+void document_text_layout_entry(struct thread* thread) {
+  struct document_text_layout* layout = (struct document_text_layout*)thread->data;
+  struct document_text_render_info render_info = layout->segments[0].render_info;
+  document_text_layout_bind(&render_info, &layout->segments[0]);
+  int result = document_text_layout_run(&render_info, &layout->segments[0]);
+  layout->valid = 1;
+
+  // Guessed segments are of no use if the layout converged to the old one before
+  if (result!=1) {
+    atomic_increment_fileoffset_t(&layout->cancel);
+  }
+
+  for (size_t index = 1; index<layout->count; index++) {
+    struct document_text_layout_segment* segment = &layout->segments[index];
+    thread_destroy_inplace(&segment->thread);
+    if (result==1 && render_info.buffer && segment->reached) {
+      result = document_text_layout_stitch(&render_info, &layout->segments[index-1], segment);
+      layout->valid = index+1;
+    } else {
+      result = 0;
+    }
+  }
+
+  layout->last = render_info.buffer;
+  atomic_release_fileoffset_t(&layout->done, 1);
+  if (layout->editor) {
+    layout->editor->update_signal(layout->file);
+  }
+}
+
+// Worker laying out a segment with a guessed state at its start, the result is checked as soon as the segment before is done
+void document_text_layout_speculate(struct thread* thread) {
+  struct document_text_layout_segment* segment = (struct document_text_layout_segment*)thread->data;
+  struct document_text_render_info render_info = segment->render_info;
+  document_text_layout_bind(&render_info, segment);
+  segment->reached = (document_text_layout_run(&render_info, segment)==1)?1:0;
+  segment->render_info_end = render_info;
+}
+
+// Continue with the actual state at the start of a guessed segment and lay it out again until both agree, returns like document_text_layout_run
+int document_text_layout_stitch(struct document_text_render_info* render_info, struct document_text_layout_segment* previous, struct document_text_layout_segment* segment) {
+  struct visual_info* before = document_view_visual_create(previous->view, render_info->buffer, render_info->buffer_tree);
+  struct range_tree_node* first = range_tree_first(&segment->shadow->buffer);
+  struct visual_info* visuals = document_view_visual_create(segment->view, first, &segment->shadow->buffer);
+  if (document_text_layout_continues(render_info, &segment->render_info) && visuals->detail_before==before->detail_before && visuals->keyword_color==before->keyword_color && visuals->keyword_length==before->keyword_length && visuals->spell_length==before->spell_length && visuals->displacement==before->displacement && visuals->rewind==before->rewind) {
+    *render_info = segment->render_info_end;
+    return 1;
+  }
+
+  visuals->detail_before = before->detail_before;
+  visuals->keyword_color = before->keyword_color;
+  visuals->keyword_length = before->keyword_length;
+  visuals->spell_length = before->spell_length;
+  visuals->displacement = before->displacement;
+  visuals->rewind = before->rewind;
+  visuals->dirty |= VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+  visuals->ascii = VISUAL_ASCII_UNKNOWN;
+  range_tree_node_update_calc_all(first, &segment->shadow->buffer);
+
+  document_text_layout_bind(render_info, segment);
+  int result = document_text_layout_run(render_info, segment);
+  if (result!=2) {
+    return result;
+  }
+
+  // The guessed layout is kept from here on, only the bracket depth behind the segment differs
+  int depth[VISUAL_BRACKET_MAX];
+  for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+    depth[n] = render_info->depth_new[n];
+  }
+
+  struct range_tree_node* node = render_info->buffer;
+  while (node && segment->offset+range_tree_node_offset(node)<segment->end) {
+    visuals = document_view_visual_create(segment->view, node, &segment->shadow->buffer);
+    for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+      depth[n] += visuals->brackets[n].diff;
+    }
+
+    node = range_tree_node_next(node);
+  }
+
+  *render_info = segment->render_info_end;
+  for (size_t n = 0; n<VISUAL_BRACKET_MAX; n++) {
+    render_info->depth_new[n] = depth[n];
+    render_info->depth_old[n] = depth[n];
+    render_info->depth_line[n] = depth[n];
+  }
+
+  return 1;
+}
+
+// Restore the state at the start of the page the layout stopped at, its first character was already marked and is going to be marked again
+void document_text_layout_resume(struct document_text_render_info* render_info, struct document_view* view) {
+  struct visual_info* visuals = document_view_visual_create(view, render_info->buffer, render_info->buffer_tree);
+  render_info->visual_detail = visuals->detail_before|VISUAL_DETAIL_WHITESPACED_COMPLETE;
+  render_info->visual_detail &= ~(VISUAL_DETAIL_WHITESPACED_START|VISUAL_DETAIL_STOPPED_INDENTATION);
+  render_info->keyword_color = visuals->keyword_color;
+  render_info->keyword_length = visuals->keyword_length;
+  render_info->spell_length = visuals->spell_length;
+}
+
+// Take over the pages laid out by the workers, returns 0 if the document or the view changed meanwhile and nothing was merged
+int document_text_layout_merge(struct document_view* view, struct document_file* file) {
+  struct document_text_layout* layout = view->layout;
+  thread_destroy_inplace(&layout->thread);
+
+  struct document_text_layout_segment* segment = &layout->segments[0];
+  struct document_text_render_info render_info;
+  document_text_layout_seek(&render_info, view, file, layout->offset);
+  int same = (view->uid==layout->uid && view->wrapping==segment->view->wrapping && view->show_invisibles==segment->view->show_invisibles && file->type==segment->shadow->type && file->encoding->create==segment->shadow->encoding->create && file->newline==segment->shadow->newline && file->tabstop_width==segment->shadow->tabstop_width && (layout->last || (layout->complete && layout->valid==layout->count)) && document_text_layout_same(&render_info, &segment->render_info))?1:0;
+
+  // The copied pages still have to be the pages of the document
+  struct range_tree_node* start = render_info.buffer;
+  for (size_t index = 0; same && index<layout->valid; index++) {
+    segment = &layout->segments[index];
+    struct range_tree_node* node = start;
+    struct range_tree_node* copy = range_tree_first(&segment->shadow->buffer);
+    size_t page = 0;
+    while (same && copy) {
+      struct range_tree_node* next = range_tree_node_next(copy);
+      if (!node || node->buffer!=copy->buffer || node->offset!=copy->offset || (next?node->length!=copy->length:node->length<copy->length)) {
+        same = 0;
+      }
+
+      node = node?range_tree_node_next(node):NULL;
+      copy = next;
+      page++;
+      if (page==segment->pages) {
+        start = node;
+      }
+    }
+  }
+
+  if (same) {
+    size_t pages = 0;
+    struct range_tree_node* node = render_info.buffer;
+    for (size_t index = 0; index<layout->valid; index++) {
+      segment = &layout->segments[index];
+      int final = (index==layout->valid-1)?1:0;
+      struct range_tree_node* copy = range_tree_first(&segment->shadow->buffer);
+      for (size_t page = 0; copy && (final || page<segment->pages); page++) {
+        *document_view_visual_create(view, node, &file->buffer) = *document_view_visual_create(segment->view, copy, &segment->shadow->buffer);
+        range_tree_node_update_calc_all(node, &file->buffer);
+        pages++;
+        if (final && copy==layout->last) {
+          break;
+        }
+
+        node = range_tree_node_next(node);
+        copy = range_tree_node_next(copy);
+      }
+    }
+
+    // The next window doubles if the worker needed the whole window, small changes keep the copies small
+    layout->pages = pages*2;
+    if (layout->pages<TIPPSE_LAYOUT_PAGES_MIN) {
+      layout->pages = TIPPSE_LAYOUT_PAGES_MIN;
+    } else if (layout->pages>TIPPSE_LAYOUT_PAGES_MAX) {
+      layout->pages = TIPPSE_LAYOUT_PAGES_MAX;
+    }
+  } else {
+    layout->pages = TIPPSE_LAYOUT_PAGES_MIN;
+  }
+
+  document_text_render_destroy(&render_info);
+  document_text_layout_release(layout);
+  return same;
+}
+
+// Drop the copies of all segments
+void document_text_layout_release(struct document_text_layout* layout) {
+  for (size_t index = 0; index<layout->count; index++) {
+    document_file_destroy_shadow(layout->segments[index].shadow);
+  }
+
+  free(layout->segments);
+  layout->segments = NULL;
+  layout->count = 0;
+}
+
+// Stop the layout workers of the view and drop their copies
+void document_text_layout_cancel(struct document_view* view) {
+  struct document_text_layout* layout = view->layout;
+  if (!layout || !layout->count) {
+    return;
+  }
+
+  atomic_increment_fileoffset_t(&layout->cancel);
+  thread_destroy_inplace(&layout->thread);
+  document_text_layout_release(layout);
+}
+
+// Stop the layout workers of the view and release their state
+void document_text_layout_destroy(struct document_view* view) {
+  document_text_layout_cancel(view);
+  free(view->layout);
+  view->layout = NULL;
+}
+
 // Find next dirty pages and rerender them (background task)
 int document_text_incremental_update(struct document* base, struct document_view* view, struct document_file* file) {
-  if (file->buffer.root) {
+  if (file->buffer.root && !document_text_layout_update(view, file)) {
     struct visual_info* visuals = document_view_visual_create(view, file->buffer.root, &file->buffer);
     if (visuals->dirty) {
       struct document_text_position in;
@@ -1410,7 +2171,7 @@ int document_text_incremental_update(struct document* base, struct document_view
 
   if (file->buffer.root && file->autocomplete_offset<autocomplete_length) {
     file_offset_t displacement;
-    struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, file->autocomplete_offset, &displacement);
+    struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, file->autocomplete_offset, &displacement);
     struct stream stream;
     stream_from_page(&stream, buffer, displacement);
     struct unicode_sequencer sequencer;
@@ -1481,7 +2242,7 @@ int document_text_incremental_update(struct document* base, struct document_view
 void document_text_autocomplete(struct document* base, struct document_view* view, struct document_file* file) {
   if (file->autocomplete_last && range_tree_length(&file->buffer)>0) {
     file_offset_t displacement;
-    struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, view->offset, &displacement);
+    struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, view->offset, &displacement);
     struct stream stream;
     stream_from_page(&stream, buffer, displacement);
     struct unicode_sequencer sequencer;
@@ -1491,7 +2252,7 @@ void document_text_autocomplete(struct document* base, struct document_view* vie
       stream_destroy(&stream);
 
       file_offset_t offset = document_text_word_transition_prev(base, view, file, view->offset);
-      struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, offset, &displacement);
+      struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, offset, &displacement);
       stream_from_page(&stream, buffer, displacement);
       unicode_sequencer_clear(&sequencer, file->encoding, &stream);
       struct trie_node* parent = NULL;
@@ -1774,7 +2535,7 @@ void document_text_draw(struct document* base, struct screen* screen, struct spl
     size_t length = 0;
 
     file_offset_t displacement;
-    struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, view->offset, &displacement);
+    struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, view->offset, &displacement);
     struct stream stream;
     stream_from_page(&stream, buffer, displacement);
     struct unicode_sequencer sequencer;
@@ -1784,7 +2545,7 @@ void document_text_draw(struct document* base, struct screen* screen, struct spl
       stream_destroy(&stream);
 
       file_offset_t offset = document_text_word_transition_prev(base, view, file, view->offset);
-      struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, offset, &displacement);
+      struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, offset, &displacement);
       stream_from_page(&stream, buffer, displacement);
       unicode_sequencer_clear(&sequencer, file->encoding, &stream);
       int prefix = 0;
@@ -1849,11 +2610,31 @@ void document_text_draw(struct document* base, struct screen* screen, struct spl
   const char* tabstop[TIPPSE_TABSTOP_MAX] = {"Auto", "Tab", "Space"};
 
   visuals = file->buffer.root?document_view_visual_create(view, file->buffer.root, &file->buffer):NULL;
+  int dirty = visuals?visuals->dirty:0;
+  file_offset_t lines = visuals?(file_offset_t)visuals->lines:0;
+  position_t scroll_y_max = visuals?visuals->ys:0;
+  if (dirty) {
+    // Use the node summaries or the line index of the loaded file until the layout is complete
+    int complete = 1;
+    file_offset_t indexed = document_file_summary_lines(file);
+    if (indexed==FILE_OFFSET_T_MAX) {
+      indexed = document_file_index_lines(file, &complete);
+    }
+
+    if (indexed!=FILE_OFFSET_T_MAX && indexed>=lines) {
+      lines = indexed;
+      dirty = !complete;
+      if (!view->wrapping) {
+        scroll_y_max = (position_t)indexed;
+      }
+    }
+  }
+
   char status[1024];
-  sprintf(&status[0], "%s%s%lld/%lld:%lld - %lld/%lld byte - %s*%d %s %s/%s %s", (visuals?visuals->dirty:0)?"? ":"", (file->buffer.root?(file->buffer.root->inserter&TIPPSE_INSERTER_FILE):0)?"File ":"", (long long int)(visuals?visuals->lines+1:0), (long long int)(cursor.line+1), (long long int)(cursor.column+1), (long long int)view->offset, (long long int)range_tree_length(&file->buffer), tabstop[file->tabstop], file->tabstop_width, newline[file->newline], (*file->type->name)(), (*file->type->type)(file->type), (*file->encoding->name)());
+  sprintf(&status[0], "%s%s%lld/%lld:%lld - %lld/%lld byte - %s*%d %s %s/%s %s", dirty?"? ":"", (file->buffer.root?(file->buffer.root->inserter&TIPPSE_INSERTER_FILE):0)?"File ":"", (long long int)(visuals?lines+1:0), (long long int)(cursor.line+1), (long long int)(cursor.column+1), (long long int)view->offset, (long long int)range_tree_length(&file->buffer), tabstop[file->tabstop], file->tabstop_width, newline[file->newline], (*file->type->name)(), (*file->type->type)(file->type), (*file->encoding->name)());
   splitter_status(splitter, &status[0]);
 
-  view->scroll_y_max = visuals?visuals->ys:0;
+  view->scroll_y_max = scroll_y_max;
   splitter_scrollbar(splitter, screen);
 }
 
@@ -2482,6 +3263,8 @@ void document_text_lower_indentation(struct document* base, struct document_view
   in_offset.offset = high;
   document_text_cursor_position(view, file, &in_offset, &out_end, 0, 1);
 
+  struct document_transaction transaction;
+  document_transaction_create_inplace(&transaction, file);
   while (out_end.line>=out_start.line) {
     in_line_column.column = 0;
     in_line_column.line = out_end.line;
@@ -2504,11 +3287,14 @@ void document_text_lower_indentation(struct document* base, struct document_view
     stream_destroy(&stream);
 
     if (length>0) {
-      document_file_delete(file, out.offset, length);
+      document_transaction_replace(&transaction, out.offset, length, NULL, 0);
     }
 
     out_end.line--;
   }
+
+  document_transaction_commit(&transaction);
+  document_transaction_destroy_inplace(&transaction);
 }
 
 // Raise indentation for selected range
@@ -2531,6 +3317,8 @@ void document_text_raise_indentation(struct document* base, struct document_view
   in_offset.offset = high;
   document_text_cursor_position(view, file, &in_offset, &out_end, 0, 1);
 
+  struct document_transaction transaction;
+  document_transaction_create_inplace(&transaction, file);
   while (out_end.line>=out_start.line) {
     in_line_column.column = 0;
     in_line_column.line = out_end.line;
@@ -2556,11 +3344,14 @@ void document_text_raise_indentation(struct document* base, struct document_view
     }
 
     if (!empty_lines || out_line_start.offset!=out_line_end.offset) {
-      document_file_insert_utf8(file, out_line_start.offset, &utf8[0], size, 0);
+      document_transaction_insert_utf8(&transaction, out_line_start.offset, &utf8[0], size);
     }
 
     out_end.line--;
   }
+
+  document_transaction_commit(&transaction);
+  document_transaction_destroy_inplace(&transaction);
 }
 
 // Move given block up or down (TODO: not multiselection aware / caller)
@@ -2874,7 +3665,7 @@ file_offset_t document_text_word_transition_prev(struct document* base, struct d
     } else if (rendered==-1) {
       document_text_render_destroy(&render_info);
       file_offset_t diff;
-      struct range_tree_node* node = range_tree_node_find_offset(file->buffer.root, offset, &diff);
+      struct range_tree_node* node = range_tree_find_offset(&file->buffer, offset, &diff);
       if (!node) {
         return 0;
       }
@@ -2899,6 +3690,9 @@ void document_text_transform(struct document* base, struct trie* transformation,
   stream_from_plain(&stream, NULL, 0);
   struct unicode_sequencer sequencer;
 
+  struct document_transaction transaction;
+  document_transaction_create_inplace(&transaction, file);
+
   uint8_t recoded[1024];
   size_t recode = 0;
   file_offset_t recode_from = 0;
@@ -2907,9 +3701,9 @@ void document_text_transform(struct document* base, struct trie* transformation,
       seek = 0;
       offset = 0;
       file_offset_t displacement;
-      struct range_tree_node* buffer = range_tree_node_find_offset(file->buffer.root, from, &displacement);
+      struct range_tree_node* buffer = range_tree_find_offset(&file->buffer, from, &displacement);
       if (!buffer) {
-        return;
+        break;
       }
 
       stream_destroy(&stream);
@@ -2921,12 +3715,8 @@ void document_text_transform(struct document* base, struct trie* transformation,
     size_t length = 0;
     struct unicode_sequence* sequence = unicode_transform(transformation, &sequencer, offset, &advance, &length);
     if (recode>512 || (!sequence && recode>256)) {
-      document_file_delete(file, recode_from, from-recode_from);
-      document_file_reduce(&to, recode_from, from-recode_from);
-      document_file_insert(file, recode_from, &recoded[0], recode, 0);
-      document_file_expand(&to, recode_from, recode);
+      document_transaction_replace(&transaction, recode_from, from-recode_from, &recoded[0], recode);
       recode = 0;
-      seek = 1;
     }
 
     if (!sequence) {
@@ -2953,8 +3743,12 @@ void document_text_transform(struct document* base, struct trie* transformation,
     }
   }
 
+  stream_destroy(&stream);
+
   if (recode>0) {
-    document_file_delete(file, recode_from, from-recode_from);
-    document_file_insert(file, recode_from, &recoded[0], recode, 0);
+    document_transaction_replace(&transaction, recode_from, from-recode_from, &recoded[0], recode);
   }
+
+  document_transaction_commit(&transaction);
+  document_transaction_destroy_inplace(&transaction);
 }
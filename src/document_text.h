@@ -7,6 +7,7 @@
 #include "document.h"
 #include "library/encoding.h"
 #include "library/stream.h"
+#include "library/thread.h"
 #include "visualinfo.h"
 
 // Scan at max the first 2MiB of the file for autocomplete information
@@ -14,6 +15,19 @@
 #define TIPPSE_TAB_MAX (64)
 #define TIPPSE_AUTOCOMPLETE_HINT_MAX (1024)
 
+// Pages handed to a layout worker at once, the window starts small after scrolling and doubles with every merge
+#define TIPPSE_LAYOUT_PAGES_MIN 64
+#define TIPPSE_LAYOUT_PAGES_MAX 4096
+// Segments of a window laid out in parallel, a segment has at least TIPPSE_LAYOUT_PAGES_MIN pages
+#define TIPPSE_LAYOUT_SEGMENTS 16
+// Dirty pages laid out by the worker between two checks for cancellation
+#define TIPPSE_LAYOUT_CHUNK 64
+// Bytes copied behind the window, decoding and keyword lookahead at its end see the same text as in the document
+#define TIPPSE_LAYOUT_LOOKAHEAD 65536
+
+// ASCII layout path in use, the test suite turns it off to compare with the unicode sequencer
+extern int document_text_ascii_path;
+
 struct document_text {
   struct document vtbl;             // virtual table of document
 };
@@ -59,6 +73,39 @@ struct document_text_render_info {
   const struct range_tree_node* selection; // access to selection buffer, current page in tree
 };
 
+// Part of a layout window with a private copy of its pages, all segments but the first start with a guessed state
+struct document_text_layout_segment {
+  struct document_text_layout* layout; // layout the segment belongs to
+  struct document_file* shadow;     // private copy of the pages
+  struct document_view* view;       // private view of the copy
+  struct document_text_render_info render_info; // renderer state at the first page
+  struct document_text_render_info render_info_end; // renderer state behind the segment after a guessed start
+  file_offset_t offset;             // offset of the first page
+  file_offset_t end;                // offset behind the segment
+  size_t pages;                     // pages in the segment
+  int reached;                      // worker reached the end of the segment
+  struct thread thread;             // worker thread of a guessed segment
+};
+
+// Layout of dirty pages by worker threads, they work on private copies of the pages and the main thread merges the result
+struct document_text_layout {
+  struct document_file* file;       // document the pages were copied from
+  struct editor* editor;            // editor woken up by the worker, NULL if none
+  struct document_text_layout_segment* segments; // segments of the window, allocated while the workers run
+  size_t count;                     // segments in use, 0 if no worker is running
+  size_t valid;                     // segments laid out with the state of the document
+  int processors;                   // processors available for the segments
+  int uid;                          // visual cache of the view when the pages were copied
+  file_offset_t offset;             // offset of the first page
+  size_t pages;                     // pages in the next window
+  file_offset_t view_offset;        // view offset when the last window was copied
+  int complete;                     // copy of the last segment reaches the end of the document
+  struct range_tree_node* last;     // page of the last valid segment the worker stopped at, NULL if it ran through the copy
+  file_offset_t done;               // worker is finished, accessed atomically
+  file_offset_t cancel;             // workers should stop, accessed atomically
+  struct thread thread;             // worker thread of the first segment
+};
+
 // Document position structure
 struct document_text_position {
   long type;                            // visual seek type
@@ -111,6 +158,24 @@ void document_text_render_clear(struct document_text_render_info* render_info, p
 void document_text_render_destroy(struct document_text_render_info* render_info);
 void document_text_render_seek(struct document_text_render_info* render_info, struct document_view* view, struct range_tree* buffer, struct encoding* encoding, const struct document_text_position* in);
 int document_text_split_buffer(struct range_tree_node* buffer, struct document_file* file);
+bool_t document_text_ascii_page(struct visual_info* visuals, struct range_tree_node* buffer);
+size_t document_text_collect_ascii(struct document_text_render_info* render_info, const struct document_text_position* in, const uint8_t* text, size_t length, bool_t wrapping, int tabstop_width, bool_t* indented, bool_t* bracketed_line, int* fill);
+int document_text_layout_update(struct document_view* view, struct document_file* file);
+void document_text_layout_seek(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, file_offset_t offset);
+int document_text_layout_same(const struct document_text_render_info* left, const struct document_text_render_info* right);
+int document_text_layout_continues(const struct document_text_render_info* left, const struct document_text_render_info* right);
+int document_text_layout_begin(struct document_view* view, struct document_file* file);
+void document_text_layout_guess(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, struct range_tree_node* buffer, file_offset_t offset);
+void document_text_layout_bind(struct document_text_render_info* render_info, struct document_text_layout_segment* segment);
+int document_text_layout_run(struct document_text_render_info* render_info, struct document_text_layout_segment* segment);
+void document_text_layout_entry(struct thread* thread);
+void document_text_layout_speculate(struct thread* thread);
+int document_text_layout_stitch(struct document_text_render_info* render_info, struct document_text_layout_segment* previous, struct document_text_layout_segment* segment);
+void document_text_layout_resume(struct document_text_render_info* render_info, struct document_view* view);
+int document_text_layout_merge(struct document_view* view, struct document_file* file);
+void document_text_layout_release(struct document_text_layout* layout);
+void document_text_layout_cancel(struct document_view* view);
+void document_text_layout_destroy(struct document_view* view);
 int document_text_collect_span(struct document_text_render_info* render_info, struct document_view* view, struct document_file* file, const struct document_text_position* in, struct document_text_position* out, int dirty_pages, int cancel);
 int document_text_prerender_span(struct document_text_render_info* render_info, struct screen* screen, const struct document_view* view, struct document_file* file, const struct document_text_position* in, struct document_text_position* out, int dirty_pages, int cancel);
 int document_text_render_span(struct document_text_render_info* render_info, struct screen* screen, struct splitter* splitter, struct document_view* view, struct document_file* file, const struct document_text_position* in, struct document_text_position* out, int dirty_pages, int cancel, position_t scroll_x, position_t scroll_y);
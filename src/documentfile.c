@@ -2,6 +2,7 @@
 
 #include "documentfile.h"
 
+#include "clipboard.h"
 #include "config.h"
 #include "documentundo.h"
 #include "documentview.h"
@@ -13,8 +14,10 @@
 #include "library/encoding/ascii.h"
 #include "editor.h"
 #include "document.h"
+#include "document_text.h"
 #include "library/file.h"
 #include "library/filecache.h"
+#include "library/filesink.h"
 #include "filetype.h"
 #include "filetype/c.h"
 #include "filetype/compile.h"
@@ -26,12 +29,15 @@
 #include "filetype/sql.h"
 #include "filetype/text.h"
 #include "filetype/xml.h"
+#include "library/atomic.h"
+#include "library/count.h"
 #include "library/fragment.h"
 #include "library/list.h"
 #include "library/misc.h"
 #include "library/rangetree.h"
 #include "library/trie.h"
 #include "library/unicode.h"
+#include "library/watch.h"
 
 extern struct config_cache screen_color_codes[];
 extern struct config_cache visual_color_codes[VISUAL_FLAG_COLOR_MAX+1];
@@ -92,8 +98,16 @@ struct document_file* document_file_create(int save, int config, struct editor*
   base->config = config?config_create():NULL;
   range_tree_create_inplace(&base->buffer, &base->hook.callback, base->config?TIPPSE_RANGETREE_CAPS_VISUAL:0);
   base->spellcheck = spell_create(base);
-  range_tree_create_inplace(&base->bookmarks, NULL, 0);
+  range_tree_create_inplace(&base->bookmarks, NULL, TIPPSE_RANGETREE_CAPS_SLIM);
+  base->append = NULL;
+  base->append_length = 0;
+  base->coarsen_offset = 0;
   base->cache = NULL;
+  base->saving = NULL;
+  base->index = NULL;
+  base->summary_mode = TIPPSE_DOCUMENT_SUMMARY_NONE;
+  base->summary_newline = 0;
+  base->undo_save_pending = SIZE_T_MAX;
   base->caches = list_create(sizeof(struct document_file_cache));
   base->binary = 0;
   base->draft = 0;
@@ -137,6 +151,9 @@ struct document_file* document_file_create(int save, int config, struct editor*
 
 // Clear file operations
 void document_file_clear(struct document_file* base, int all) {
+  document_file_cancel_views(base);
+  document_file_save_finish(base, 1);
+  document_file_index_end(base);
   if (base->cache) {
     document_file_dereference_cache(base, base->cache);
     file_cache_dereference(base->cache);
@@ -159,6 +176,7 @@ void document_file_destroy(struct document_file* base) {
   document_file_clear(base, 1);
   range_tree_destroy_inplace(&base->buffer);
   range_tree_destroy_inplace(&base->bookmarks);
+  document_file_append_release(base);
   document_file_close_pipe(base);
   document_undo_empty(base, base->undos);
   document_undo_empty(base, base->redos);
@@ -186,6 +204,57 @@ void document_file_destroy(struct document_file* base) {
   free(base);
 }
 
+// Create a private document sharing a range of pages with another document, only the parts needed to lay out the pages in a worker thread are set up
+struct document_file* document_file_create_shadow(struct document_file* base, struct document_view* view, file_offset_t offset, file_offset_t length) {
+  struct document_file* shadow = (struct document_file*)malloc(sizeof(struct document_file));
+  shadow->hook.file = shadow;
+  shadow->hook.callback.fragment_reference = document_file_fragment_reference;
+  shadow->hook.callback.fragment_dereference = document_file_fragment_dereference;
+  shadow->hook.callback.node_combine = document_file_node_combine;
+  shadow->hook.callback.node_invalidate = document_file_node_invalidate;
+  shadow->hook.callback.node_destroy = document_file_node_destroy;
+
+  shadow->editor = NULL;
+  shadow->splitter = NULL;
+  shadow->config = NULL;
+  shadow->spellcheck = NULL;
+  shadow->cache = NULL;
+  shadow->saving = NULL;
+  shadow->index = NULL;
+  shadow->type = base->type;
+  shadow->encoding = (*base->encoding->create)();
+  shadow->tabstop = base->tabstop;
+  shadow->tabstop_width = base->tabstop_width;
+  shadow->newline = base->newline;
+  shadow->summary_mode = base->summary_mode;
+  shadow->summary_newline = base->summary_newline;
+  shadow->views = list_create(sizeof(struct document_view*));
+  list_insert(shadow->views, NULL, &view);
+  shadow->caches = list_create(sizeof(struct document_file_cache));
+
+  range_tree_create_inplace(&shadow->buffer, &shadow->hook.callback, TIPPSE_RANGETREE_CAPS_VISUAL);
+  struct range_tree_build build;
+  range_tree_build_begin(&build, &shadow->buffer);
+  range_tree_build_copy(&build, base->buffer.root, offset, length);
+  range_tree_build_end(&build);
+  return shadow;
+}
+
+// Destroy private document and its views, the file type belongs to the original document
+void document_file_destroy_shadow(struct document_file* base) {
+  range_tree_destroy_inplace(&base->buffer);
+
+  while (base->views->first) {
+    document_view_destroy(*(struct document_view**)list_object(base->views->first));
+    list_remove(base->views, base->views->first);
+  }
+
+  list_destroy(base->views);
+  list_destroy(base->caches);
+  (*base->encoding->destroy)(base->encoding);
+  free(base);
+}
+
 // Set up file name and select file type depending on the suffix
 void document_file_name(struct document_file* base, const char* filename) {
   if (filename!=base->filename) {
@@ -359,6 +428,7 @@ void document_file_pipe_entry(struct thread* thread) {
 // Create another process or thread and route the output into the file
 void document_file_create_pipe(struct document_file* base, struct document_file_pipe_operation* pipe_operation) {
   document_file_close_pipe(base);
+  document_file_save_settle(base);
 
   range_tree_destroy_inplace(&base->buffer);
   range_tree_create_inplace(&base->buffer, &base->hook.callback, base->config?TIPPSE_RANGETREE_CAPS_VISUAL:0);
@@ -373,6 +443,7 @@ void document_file_create_pipe(struct document_file* base, struct document_file_
 
   base->piped = TIPPSE_PIPE_ACTIVE;
   base->pipe_operation = pipe_operation;
+  document_file_cancel_views(base);
   (*base->type->destroy)(base->type);
   if (base->pipe_operation->operation==TIPPSE_PIPEOP_EXECUTE) {
     base->type = file_type_compile_create(base->config, "compiler_output");
@@ -408,8 +479,10 @@ void document_file_fill_pipe(struct document_file* base, uint8_t* buffer, size_t
   }
 }
 
-// Append incoming data from pipe queue
+// Append incoming data from pipe queue, also completes a finished background save
 void document_file_flush_pipe(struct document_file* base) {
+  document_file_save_finish(base, 0);
+  document_file_save_settle(base);
   mutex_lock(&base->pipe_mutex);
   while (base->pipe_queue->first) {
     struct document_file_pipe_block* block = (struct document_file_pipe_block*)list_object(base->pipe_queue->first);
@@ -462,6 +535,7 @@ void document_file_load(struct document_file* base, const char* filename, int re
   document_file_clear(base, !reload);
   int opened = 0;
   if (!is_directory(filename)) {
+    document_file_journal_replay(filename);
     struct file* f = file_create(filename, TIPPSE_FILE_READ);
     if (f) {
       opened = 1;
@@ -471,6 +545,8 @@ void document_file_load(struct document_file* base, const char* filename, int re
       file_offset_t length = file_seek(f, 0, TIPPSE_SEEK_END);
       file_seek(f, 0, TIPPSE_SEEK_START);
       file_offset_t offset = 0;
+      struct range_tree_build build;
+      range_tree_build_begin(&build, &base->buffer);
       while (1) {
         file_offset_t block = 0;
         struct fragment* fragment = NULL;
@@ -492,11 +568,12 @@ void document_file_load(struct document_file* base, const char* filename, int re
           break;
         }
 
-        range_tree_insert(&base->buffer, offset, fragment, 0, fragment->length, 0, 0, NULL);
+        range_tree_build_append(&build, fragment, 0, fragment->length, 0, 0, NULL);
         fragment_dereference(fragment, &base->hook.callback);
         offset += block;
       }
 
+      range_tree_build_end(&build);
       file_destroy(f);
     }
   }
@@ -507,6 +584,7 @@ void document_file_load(struct document_file* base, const char* filename, int re
   }
 
   document_file_detect_properties(base);
+  document_file_index_begin(base);
   range_tree_resize(&base->bookmarks, range_tree_length(&base->buffer), 0);
   if (!reload) {
     document_undo_empty(base, base->undos);
@@ -527,18 +605,19 @@ void document_file_load(struct document_file* base, const char* filename, int re
 // Load file from memory
 void document_file_load_memory(struct document_file* base, const uint8_t* buffer, size_t length, const char* name) {
   document_file_clear(base, 1);
-  file_offset_t offset = 0;
+  struct range_tree_build build;
+  range_tree_build_begin(&build, &base->buffer);
   while (length>0) {
     size_t max = (length>TREE_BLOCK_LENGTH_MID)?TREE_BLOCK_LENGTH_MID:length;
     uint8_t* copy = (uint8_t*)malloc(max);
     memcpy(copy, buffer, max);
     struct fragment* fragment = fragment_create_memory(copy, max);
-    range_tree_insert(&base->buffer, offset, fragment, 0, max, 0, 0, NULL);
+    range_tree_build_append(&build, fragment, 0, max, 0, 0, NULL);
     fragment_dereference(fragment, &base->hook.callback);
-    offset += max;
     length -= max;
     buffer += max;
   }
+  range_tree_build_end(&build);
 
   document_undo_empty(base, base->undos);
   document_undo_empty(base, base->redos);
@@ -548,68 +627,61 @@ void document_file_load_memory(struct document_file* base, const uint8_t* buffer
   document_file_reset_views(base, 1);
 }
 
-// Save file directly to file system
-int document_file_save_plain(struct document_file* base, const char* filename) {
+// Write content of a tree into a file, the progress is shown if an editor is given
+int document_file_write(struct range_tree* buffer, const char* filename, struct editor* editor) {
   struct file* f = file_create(filename, TIPPSE_FILE_READ|TIPPSE_FILE_WRITE|TIPPSE_FILE_CREATE|TIPPSE_FILE_TRUNCATE);
   if (!f) {
     return 0;
   }
 
   int success = 1;
-  if (base->buffer.root) {
-    file_offset_t max = range_tree_length(&base->buffer);
+  if (buffer->root) {
+    file_offset_t max = range_tree_length(buffer);
+    struct file_sink sink;
+    file_sink_create_inplace(&sink, f);
     struct stream stream;
-    stream_from_page(&stream, range_tree_first(&base->buffer), 0);
+    stream_from_page(&stream, range_tree_first(buffer), 0);
     while (!stream_end(&stream)) {
-      size_t length = stream_cache_length(&stream)-stream_displacement(&stream);
-      if (file_write(f, (void*)stream_buffer(&stream), length)!=length) {
-        success = 0;
+      if (!file_sink_stream(&sink, &stream)) {
         break;
       }
       stream_next(&stream);
-      if (base->editor) {
-        editor_process_message(base->editor, "Saving...", stream_offset(&stream), max);
+      if (editor) {
+        editor_process_message(editor, "Saving...", stream_offset(&stream), max);
       }
     }
     stream_destroy(&stream);
+    success = file_sink_flush(&sink);
+    file_sink_destroy_inplace(&sink);
   }
 
   file_destroy(f);
-  document_undo_mark_save_point(base);
+  return success;
+}
+
+// Save file directly to file system
+int document_file_save_plain(struct document_file* base, const char* filename) {
+  int success = document_file_write(&base->buffer, filename, base->editor);
+  if (success) {
+    document_undo_mark_save_point(base);
+  }
+
   return success;
 }
 
 // Save file, uses a temporary file if necessary
 int document_file_save(struct document_file* base, const char* filename) {
+  document_file_save_finish(base, 1);
   int success = 0;
-  if (base->buffer.root && (base->buffer.root->inserter&TIPPSE_INSERTER_FILE)) {
-    char* tmpname = combine_string(filename, ".save.tmp");
-    if (document_file_save_plain(base, tmpname)) {
-      if (base->cache) {
-        document_undo_cache_invalidate(base, base->cache);
-      }
-
-      if (rename(tmpname, filename)==0) {
-        document_file_load(base, filename, 1, 0);
-        if (base->editor) {
-          editor_console_update(base->editor, "Saved!", SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
-        }
-        success = 1;
-      } else {
-        if (base->editor) {
-          editor_console_update(base->editor, "Renaming failed!", SIZE_T_MAX, CONSOLE_TYPE_ERROR);
-        }
-      }
-    } else {
-      if (base->editor) {
-        editor_console_update(base->editor, "Writing failed!", SIZE_T_MAX, CONSOLE_TYPE_ERROR);
-      }
+  if (document_file_save_patch(base, filename)) {
+    if (base->editor) {
+      editor_console_update(base->editor, "Saved!", SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
     }
-
-    free(tmpname);
+    success = 1;
+  } else if (base->buffer.root && (base->buffer.root->inserter&TIPPSE_INSERTER_FILE)) {
+    success = document_file_save_begin(base, filename);
   } else {
     if (document_file_save_plain(base, filename)) {
-      document_undo_mark_save_point(base);
       if (base->editor) {
         editor_console_update(base->editor, "Saved!", SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
       }
@@ -621,21 +693,696 @@ int document_file_save(struct document_file* base, const char* filename) {
     }
 
     if (base->cache) {
-      document_file_dereference_cache(base, base->cache);
-      file_cache_dereference(base->cache);
-      base->cache = file_cache_create(filename);
-      document_file_reference_cache(base, base->cache);
+      document_file_recache(base, filename);
+    }
+  }
+
+  return success;
+}
+
+// Write a snapshot of the document into a temporary file, the user continues editing while a worker thread does this
+int document_file_save_begin(struct document_file* base, const char* filename) {
+  struct document_file_save* save = (struct document_file_save*)malloc(sizeof(struct document_file_save));
+  save->file = base;
+  save->snapshot = NULL;
+  save->first = range_tree_first(&base->buffer);
+  mutex_create_inplace(&save->lock);
+  save->filename = strdup(filename);
+  save->tmpname = combine_string(filename, ".save.tmp");
+  save->success = 0;
+  save->threaded = (TIPPSE_DOCUMENT_SAVE_THREAD && base->editor)?1:0;
+  save->finished = 0;
+  document_undo_chain(base, base->undos);
+  base->undo_save_pending = base->undos->count;
+  base->saving = save;
+
+  if (save->threaded) {
+    editor_console_update(base->editor, "Saving...", SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
+    thread_create_inplace(&save->thread, document_file_save_entry, save);
+    return 1;
+  }
+
+  document_file_save_snapshot(save);
+  save->success = document_file_write(save->snapshot, save->tmpname, NULL);
+  save->finished = 1;
+  return document_file_save_finish(base, 0);
+}
+
+// Copy the leaves of the buffer for the save unless it was done already. The worker copies while the editor only reads
+// the buffer, the editor copies itself if it is going to change the buffer before. Leaves split for rendering are
+// joined again, the fragments aren't registered at the document since the copy never leaves the save.
+void document_file_save_snapshot(struct document_file_save* save) {
+  mutex_lock(&save->lock);
+  if (!save->snapshot) {
+    struct range_tree* snapshot = range_tree_create(NULL, 0);
+    struct range_tree_build build;
+    range_tree_build_begin(&build, snapshot);
+    for (struct range_tree_node* node = save->first; node; node = node->next) {
+      if (build.last && build.last->buffer==node->buffer && build.last->offset+build.last->length==node->offset) {
+        build.last->length += node->length;
+      } else {
+        range_tree_build_append(&build, node->buffer, node->offset, node->length, 0, 0, NULL);
+      }
+    }
+
+    range_tree_build_end(&build);
+    save->snapshot = snapshot;
+  }
+
+  mutex_unlock(&save->lock);
+}
+
+// The buffer is going to change, a running save must have its copy first
+void document_file_save_settle(struct document_file* base) {
+  if (base->saving) {
+    document_file_save_snapshot(base->saving);
+  }
+}
+
+// Worker thread writing the snapshot, the editor is woken up afterwards to finish the save
+void document_file_save_entry(struct thread* thread) {
+  struct document_file_save* save = (struct document_file_save*)thread->data;
+  document_file_save_snapshot(save);
+  save->success = document_file_write(save->snapshot, save->tmpname, NULL);
+  atomic_increment_fileoffset_t(&save->finished);
+  save->file->editor->update_signal(save->file);
+}
+
+// Replace the destination with the written snapshot as soon the worker is done (or wait for it)
+int document_file_save_finish(struct document_file* base, int wait) {
+  struct document_file_save* save = base->saving;
+  if (!save || (!wait && !atomic_get_fileoffset_t(&save->finished))) {
+    return 0;
+  }
+
+  if (save->threaded) {
+    thread_destroy_inplace(&save->thread);
+  }
+
+  base->saving = NULL;
+  int success = 0;
+  if (!save->success) {
+    editor_console_update(base->editor, "Writing failed!", SIZE_T_MAX, CONSOLE_TYPE_ERROR);
+  } else if (rename(save->tmpname, save->filename)!=0) {
+    editor_console_update(base->editor, "Renaming failed!", SIZE_T_MAX, CONSOLE_TYPE_ERROR);
+  } else {
+    // Fragments of the document and its undo steps still read the replaced file through the old cache
+    if (base->cache) {
+      file_cache_detach(base->cache);
+    }
+
+    if (range_tree_same(&base->buffer, save->snapshot)) {
+      document_file_rebind(base, save->filename);
+      document_undo_mark_save_point(base);
+    } else {
+      // Changed meanwhile, the next save finds out what differs from the new file
+      document_file_recache(base, save->filename);
+      base->undo_save_point = base->undo_save_pending;
+    }
+
+    base->undo_save_pending = SIZE_T_MAX;
+    editor_console_update(base->editor, "Saved!", SIZE_T_MAX, CONSOLE_TYPE_NORMAL);
+    success = 1;
+  }
+
+  range_tree_destroy(save->snapshot);
+  mutex_destroy_inplace(&save->lock);
+  free(save->tmpname);
+  free(save->filename);
+  free(save);
+  return success;
+}
+
+// Saved file replaced the loaded one, take the content from the new file without rebuilding the document
+void document_file_rebind(struct document_file* base, const char* filename) {
+  document_file_index_end(base);
+  struct file_cache* cache = file_cache_create(filename);
+  document_file_reference_cache(base, cache);
+  struct fragment* fragment = fragment_create_file(cache, 0, range_tree_length(&base->buffer), &base->hook.callback);
+  range_tree_rebind(&base->buffer, fragment);
+  fragment_dereference(fragment, &base->hook.callback);
+
+  if (base->cache) {
+    document_file_dereference_cache(base, base->cache);
+    file_cache_dereference(base->cache);
+  }
+
+  base->cache = cache;
+}
+
+// Let the base cache refer to the file again, e.g. after it was replaced
+void document_file_recache(struct document_file* base, const char* filename) {
+  document_file_index_end(base);
+  if (base->cache) {
+    document_file_dereference_cache(base, base->cache);
+    file_cache_dereference(base->cache);
+  }
+
+  base->cache = file_cache_create(filename);
+  document_file_reference_cache(base, base->cache);
+}
+
+// Write only the changed ranges into the loaded file if the document kept its length, a journal allows to finish the save after a crash
+int document_file_save_patch(struct document_file* base, const char* filename) {
+  if (!base->buffer.root || !(base->buffer.root->inserter&TIPPSE_INSERTER_FILE) || !base->cache || strcmp(base->cache->filename, filename)!=0 || file_cache_modified(base->cache)) {
+    return 0;
+  }
+
+  struct file* f = file_create(filename, TIPPSE_FILE_READ|TIPPSE_FILE_WRITE);
+  if (!f) {
+    return 0;
+  }
+
+  file_offset_t length = range_tree_length(&base->buffer);
+  int success = 0;
+  struct list patches;
+  list_create_inplace(&patches, sizeof(struct document_file_patch));
+  // Rewriting the whole file is cheaper than journaling most of it, moved ranges must not be read from bytes that get replaced
+  if (file_seek(f, 0, TIPPSE_SEEK_END)==length && document_file_patch_collect(base, &patches)<=length/2 && !document_file_patch_overlap(base, &patches) && !file_cache_shared(base->cache)) {
+    char* journalname = combine_string(filename, ".save.journal");
+    success = 1;
+    if (patches.count>0) {
+      success = document_file_patch_journal(base, &patches, journalname);
+      if (success) {
+        document_file_patch_invalidate(base);
+        // The document still reads the file while it is patched, the changed ranges are taken from the journal instead
+        success = document_file_journal_replay(filename);
+      }
+    }
+
+    free(journalname);
+  }
+
+  while (patches.first) {
+    list_remove(&patches, patches.first);
+  }
+
+  list_destroy_inplace(&patches);
+  file_destroy(f);
+
+  if (success) {
+    document_file_rebind(base, filename);
+    document_undo_mark_save_point(base);
+  }
+
+  return success;
+}
+
+// Collect ranges that don't refer to their own position in the loaded file, returns the number of changed bytes
+file_offset_t document_file_patch_collect(struct document_file* base, struct list* patches) {
+  file_offset_t changed = 0;
+  file_offset_t offset = 0;
+  struct document_file_patch* last = NULL;
+  struct range_tree_node* node = range_tree_first(&base->buffer);
+  while (node) {
+    struct fragment* buffer = node->buffer;
+    if (!buffer || buffer->type!=FRAGMENT_FILE || buffer->cache!=base->cache || buffer->offset+node->offset!=offset) {
+      if (last && last->offset+last->length==offset) {
+        last->length += node->length;
+      } else {
+        last = (struct document_file_patch*)list_object(list_insert_empty(patches, patches->last));
+        last->offset = offset;
+        last->length = node->length;
+      }
+
+      changed += node->length;
+    }
+
+    offset += node->length;
+    node = node->next;
+  }
+
+  return changed;
+}
+
+// Check if a range that is going to be patched is read from the loaded file at another position
+int document_file_patch_overlap(struct document_file* base, struct list* patches) {
+  file_offset_t offset = 0;
+  struct range_tree_node* node = range_tree_first(&base->buffer);
+  while (node) {
+    struct fragment* buffer = node->buffer;
+    if (buffer && buffer->type==FRAGMENT_FILE && buffer->cache==base->cache && buffer->offset+node->offset!=offset) {
+      file_offset_t low = buffer->offset+node->offset;
+      file_offset_t high = low+node->length;
+      struct list_node* it = patches->first;
+      while (it) {
+        struct document_file_patch* patch = (struct document_file_patch*)list_object(it);
+        if (patch->offset>=high) {
+          break;
+        }
+
+        if (patch->offset+patch->length>low) {
+          return 1;
+        }
+
+        it = it->next;
+      }
+    }
+
+    offset += node->length;
+    node = node->next;
+  }
+
+  return 0;
+}
+
+// Copy the bytes of the loaded file to all other holders before it is patched, the document itself is rebound afterwards
+void document_file_patch_invalidate(struct document_file* base) {
+  document_file_index_end(base);
+  document_file_cancel_views(base);
+  if (base->editor) {
+    struct list_node* it = base->editor->documents->first;
+    while (it) {
+      struct document_file* file = *(struct document_file**)list_object(it);
+      if (file!=base) {
+        document_file_cancel_views(file);
+        document_file_invalidate_cache(file, base->cache);
+      }
+
+      document_undo_cache_invalidate(file, base->cache);
+      it = it->next;
+    }
+  } else {
+    document_undo_cache_invalidate(base, base->cache);
+  }
+
+  clipboard_cache_invalidate(base->cache);
+}
+
+// Write changed ranges behind their record headers followed by an end record
+int document_file_patch_journal(struct document_file* base, struct list* patches, const char* journalname) {
+  struct file* journal = file_create(journalname, TIPPSE_FILE_WRITE|TIPPSE_FILE_CREATE|TIPPSE_FILE_TRUNCATE);
+  if (!journal) {
+    return 0;
+  }
+
+  struct file_sink sink;
+  file_sink_create_inplace(&sink, journal);
+  int success = 1;
+  struct list_node* it = patches->first;
+  while (it && success) {
+    struct document_file_patch* patch = (struct document_file_patch*)list_object(it);
+    success = file_sink_append(&sink, (const uint8_t*)patch, sizeof(struct document_file_patch), NULL, NULL) && document_file_patch_write(base, patch, &sink);
+    it = it->next;
+  }
+
+  struct document_file_patch end;
+  end.offset = FILE_OFFSET_T_MAX;
+  end.length = (file_offset_t)patches->count;
+  success = success && file_sink_append(&sink, (const uint8_t*)&end, sizeof(struct document_file_patch), NULL, NULL);
+  success = file_sink_flush(&sink) && success && file_sync(journal);
+  file_sink_destroy_inplace(&sink);
+  file_destroy(journal);
+  return success;
+}
+
+// Queue content of a changed range to the sink
+int document_file_patch_write(struct document_file* base, const struct document_file_patch* patch, struct file_sink* sink) {
+  file_offset_t split = 0;
+  struct range_tree_node* node = range_tree_find_offset(&base->buffer, patch->offset, &split);
+  struct stream stream;
+  stream_from_page(&stream, node, split);
+  int success = 1;
+  file_offset_t done = 0;
+  while (success && done<patch->length) {
+    size_t span = stream_cache_length(&stream)-stream_displacement(&stream);
+    if (span>patch->length-done) {
+      span = (size_t)(patch->length-done);
     }
+
+    success = file_sink_append(sink, stream_buffer(&stream), span, stream_page_cache(&stream), stream.cache_node);
+    done += span;
+    stream_next(&stream);
   }
 
+  stream_destroy(&stream);
   return success;
 }
 
+// Finish an interrupted in place save, journals without end record were never applied to the file and are dropped, returns 1 if the journal was applied
+int document_file_journal_replay(const char* filename) {
+  char* journalname = combine_string(filename, ".save.journal");
+  struct file* journal = file_create(journalname, TIPPSE_FILE_READ);
+  if (!journal) {
+    free(journalname);
+    return 0;
+  }
+
+  // Check for the end record first
+  int complete = 0;
+  file_offset_t count = 0;
+  struct document_file_patch patch;
+  while (file_read(journal, &patch, sizeof(struct document_file_patch))==sizeof(struct document_file_patch)) {
+    if (patch.offset==FILE_OFFSET_T_MAX) {
+      complete = (patch.length==count)?1:0;
+      break;
+    }
+
+    count++;
+    file_seek(journal, patch.length, TIPPSE_SEEK_CURRENT);
+  }
+
+  int success = 1;
+  if (complete) {
+    struct file* f = file_create(filename, TIPPSE_FILE_READ|TIPPSE_FILE_WRITE);
+    success = f?1:0;
+    if (f) {
+      uint8_t* buffer = (uint8_t*)malloc(FILE_CACHE_PAGE_SIZE);
+      file_seek(journal, 0, TIPPSE_SEEK_START);
+      while (success && count>0 && file_read(journal, &patch, sizeof(struct document_file_patch))==sizeof(struct document_file_patch)) {
+        file_offset_t done = 0;
+        while (success && done<patch.length) {
+          size_t span = (patch.length-done>FILE_CACHE_PAGE_SIZE)?FILE_CACHE_PAGE_SIZE:(size_t)(patch.length-done);
+          success = (file_read(journal, buffer, span)==span && file_write_at(f, patch.offset+done, buffer, span)==span)?1:0;
+          done += span;
+        }
+
+        count--;
+      }
+
+      free(buffer);
+      success = success && count==0 && file_sync(f);
+      file_destroy(f);
+    }
+  }
+
+  file_destroy(journal);
+  if (success) {
+    remove(journalname);
+  }
+
+  free(journalname);
+  return complete && success;
+}
+
 // Toggle "save skip" flag
 void document_file_save_skip(struct document_file* base) {
   base->save_skip ^= 1;
 }
 
+// Count the lines of a lazily loaded file in the background, the document is shown and usable meanwhile
+void document_file_index_begin(struct document_file* base) {
+  if (!TIPPSE_DOCUMENT_SAVE_THREAD || !base->editor || !base->cache || !base->buffer.root || !(base->buffer.root->inserter&TIPPSE_INSERTER_FILE)) {
+    return;
+  }
+
+  file_offset_t length = range_tree_length(&base->buffer);
+  struct document_file_index* index = (struct document_file_index*)malloc(sizeof(struct document_file_index));
+  index->file = base;
+  index->cache = base->cache;
+  file_cache_reference(index->cache);
+  index->encoding = (*base->encoding->create)();
+  index->newline = (base->newline==TIPPSE_NEWLINE_CR)?'\r':'\n';
+  index->mode = document_file_summary_encoding(index->encoding);
+  index->count = (size_t)((length+TIPPSE_DOCUMENT_INDEX_PAGE-1)/TIPPSE_DOCUMENT_INDEX_PAGE);
+  index->pages = (struct document_file_index_page*)malloc(sizeof(struct document_file_index_page)*index->count);
+  index->done = 0;
+  index->cancel = 0;
+  base->index = index;
+  thread_create_inplace(&index->thread, document_file_index_entry, index);
+}
+
+// Worker thread summarizing page by page, the editor is woken up from time to time to show the progress
+void document_file_index_entry(struct thread* thread) {
+  struct document_file_index* index = (struct document_file_index*)thread->data;
+  struct stream stream;
+  stream_from_file(&stream, index->cache, 0);
+  int64_t signaled = tick_count();
+  for (size_t page = 0; page<index->count && !atomic_get_fileoffset_t(&index->cancel); page++) {
+    file_offset_t end = (file_offset_t)(page+1)*TIPPSE_DOCUMENT_INDEX_PAGE;
+    struct document_file_index_page* summary = &index->pages[page];
+    summary->lines = 0;
+    summary->characters = 0;
+    if (index->mode!=TIPPSE_DOCUMENT_SUMMARY_NONE) {
+      while (stream_offset(&stream)<end && !stream_end(&stream)) {
+        size_t left = stream_cache_length(&stream)-stream_displacement(&stream);
+        if (left==0) {
+          stream_next(&stream);
+          continue;
+        }
+
+        const uint8_t* text = stream_buffer(&stream);
+        summary->lines += count_bytes(text, left, (uint8_t)index->newline);
+        summary->characters += (index->mode==TIPPSE_DOCUMENT_SUMMARY_UTF8)?count_utf8(text, left):left;
+        stream_forward(&stream, left);
+      }
+    } else {
+      while (stream_offset(&stream)<end && !stream_end(&stream)) {
+        size_t length;
+        codepoint_t cp = (*index->encoding->decode)(index->encoding, &stream, &length);
+        summary->characters++;
+        if (cp==index->newline) {
+          summary->lines++;
+        }
+      }
+    }
+
+    atomic_release_fileoffset_t(&index->done, (file_offset_t)(page+1));
+
+    int64_t tick = tick_count();
+    if (tick-signaled>tick_ms(100) || page+1==index->count) {
+      signaled = tick;
+      index->file->editor->update_signal(index->file);
+    }
+  }
+
+  stream_destroy(&stream);
+}
+
+// Stop the worker and drop the index
+void document_file_index_end(struct document_file* base) {
+  struct document_file_index* index = base->index;
+  if (!index) {
+    return;
+  }
+
+  atomic_increment_fileoffset_t(&index->cancel);
+  thread_destroy_inplace(&index->thread);
+  base->index = NULL;
+  file_cache_dereference(index->cache);
+  index->encoding->destroy(index->encoding);
+  free(index->pages);
+  free(index);
+}
+
+// Lines of the document counted by the index so far, FILE_OFFSET_T_MAX if the document doesn't match the indexed file anymore
+file_offset_t document_file_index_lines(struct document_file* base, int* complete) {
+  struct document_file_index* index = base->index;
+  codepoint_t newline = (base->newline==TIPPSE_NEWLINE_CR)?'\r':'\n';
+  if (!index || index->cache!=base->cache || index->encoding->create!=base->encoding->create || index->newline!=newline || !base->undo || document_undo_modified(base)) {
+    return FILE_OFFSET_T_MAX;
+  }
+
+  size_t done = (size_t)atomic_acquire_fileoffset_t(&index->done);
+  file_offset_t lines = 0;
+  for (size_t page = 0; page<done; page++) {
+    lines += index->pages[page].lines;
+  }
+
+  *complete = (done==index->count)?1:0;
+  return lines;
+}
+
+// Counting rules of encoding, newlines and characters of UTF-8 and single byte encodings are recognized byte by byte
+int document_file_summary_encoding(struct encoding* encoding) {
+  if (encoding->create==encoding_utf8_create) {
+    return TIPPSE_DOCUMENT_SUMMARY_UTF8;
+  } else if ((*encoding->character_length)(encoding)==1) {
+    return TIPPSE_DOCUMENT_SUMMARY_BYTE;
+  }
+
+  return TIPPSE_DOCUMENT_SUMMARY_NONE;
+}
+
+// Select the counting rules of the document encoding and drop all node summaries built with other rules, returns TIPPSE_DOCUMENT_SUMMARY_NONE if the encoding can't be summarized byte by byte
+int document_file_summary_prepare(struct document_file* base) {
+  int mode = (base->buffer.caps&TIPPSE_RANGETREE_CAPS_VISUAL)?document_file_summary_encoding(base->encoding):TIPPSE_DOCUMENT_SUMMARY_NONE;
+
+  codepoint_t newline = (base->newline==TIPPSE_NEWLINE_CR)?'\r':'\n';
+  if (mode!=base->summary_mode || newline!=base->summary_newline) {
+    if (base->summary_mode!=TIPPSE_DOCUMENT_SUMMARY_NONE) {
+      document_file_summary_reset(base->buffer.root);
+    }
+
+    base->summary_mode = mode;
+    base->summary_newline = newline;
+  }
+
+  return mode;
+}
+
+// Forget summaries of node and its children
+void document_file_summary_reset(struct range_tree_node* node) {
+  if (!node) {
+    return;
+  }
+
+  range_tree_node_visual(node)->summarized = 0;
+  if (!(node->inserter&TIPPSE_INSERTER_LEAF)) {
+    document_file_summary_reset(node->side[0]);
+    document_file_summary_reset(node->side[1]);
+  }
+}
+
+// Build summary of inner node from its children if both are known
+void document_file_summary_combine(struct range_tree_node* node) {
+  struct range_tree_node_visual* visual = range_tree_node_visual(node);
+  if (!range_tree_node_summarized(node->side[0]) || !range_tree_node_summarized(node->side[1])) {
+    visual->summarized = 0;
+    return;
+  }
+
+  struct range_tree_node_visual* visual0 = range_tree_node_visual(node->side[0]);
+  struct range_tree_node_visual* visual1 = range_tree_node_visual(node->side[1]);
+  visual->lines = visual0->lines+visual1->lines;
+  visual->characters = visual0->characters+visual1->characters;
+  visual->summary_length = node->length;
+  visual->summarized = 1;
+}
+
+// Line index usable for the leaf, NULL if its content has to be read
+struct document_file_index* document_file_summary_index(struct document_file* base, struct range_tree_node* node) {
+  struct document_file_index* index = base->index;
+  if (!index || node->buffer->type!=FRAGMENT_FILE || node->buffer->cache!=index->cache || index->encoding->create!=base->encoding->create || index->newline!=base->summary_newline) {
+    return NULL;
+  }
+
+  return index;
+}
+
+// Bytes of leaf that have to be read for the summary, finished pages of the line index are free
+file_offset_t document_file_summary_cost(struct document_file* base, struct range_tree_node* node) {
+  struct document_file_index* index = document_file_summary_index(base, node);
+  if (!index) {
+    return node->length;
+  }
+
+  file_offset_t start = node->buffer->offset+node->offset;
+  file_offset_t first = (start+TIPPSE_DOCUMENT_INDEX_PAGE-1)/TIPPSE_DOCUMENT_INDEX_PAGE;
+  file_offset_t last = (start+node->length)/TIPPSE_DOCUMENT_INDEX_PAGE;
+  file_offset_t done = atomic_acquire_fileoffset_t(&index->done);
+  if (last>done) {
+    last = done;
+  }
+
+  return (last>first)?node->length-(last-first)*TIPPSE_DOCUMENT_INDEX_PAGE:node->length;
+}
+
+// Count newlines and characters in range of leaf
+void document_file_summary_scan(struct document_file* base, struct range_tree_node* node, file_offset_t offset, file_offset_t length, file_offset_t* lines, file_offset_t* characters) {
+  struct document_file_index* index = document_file_summary_index(base, node);
+  file_offset_t done = index?atomic_acquire_fileoffset_t(&index->done):0;
+  uint8_t newline = (uint8_t)base->summary_newline;
+  int utf8 = (base->summary_mode==TIPPSE_DOCUMENT_SUMMARY_UTF8)?1:0;
+  file_offset_t passed = 0;
+  while (passed<length) {
+    file_offset_t chunk = length-passed;
+    if (index) {
+      file_offset_t start = node->buffer->offset+node->offset+offset+passed;
+      file_offset_t page = start/TIPPSE_DOCUMENT_INDEX_PAGE;
+      file_offset_t skip = start%TIPPSE_DOCUMENT_INDEX_PAGE;
+      if (skip==0 && chunk>=TIPPSE_DOCUMENT_INDEX_PAGE && page<done) {
+        *lines += index->pages[page].lines;
+        *characters += index->pages[page].characters;
+        passed += TIPPSE_DOCUMENT_INDEX_PAGE;
+        continue;
+      }
+
+      if (chunk>TIPPSE_DOCUMENT_INDEX_PAGE-skip) {
+        chunk = TIPPSE_DOCUMENT_INDEX_PAGE-skip;
+      }
+    }
+
+    struct stream stream;
+    stream_from_page(&stream, node, offset+passed);
+    while (chunk>0 && !stream_end(&stream)) {
+      size_t left = stream_cache_length(&stream)-stream_displacement(&stream);
+      if (left==0) {
+        stream_next(&stream);
+        continue;
+      }
+
+      if (left>chunk) {
+        left = (size_t)chunk;
+      }
+
+      const uint8_t* text = stream_buffer(&stream);
+      *lines += count_bytes(text, left, newline);
+      *characters += utf8?count_utf8(text, left):left;
+
+      passed += left;
+      chunk -= left;
+      stream_forward(&stream, left);
+    }
+
+    stream_destroy(&stream);
+    if (chunk>0) {
+      break;
+    }
+  }
+}
+
+// Build missing summaries below node, leaves are only read while the budget (if any) lasts, returns 1 if the node is summarized
+int document_file_summary_node(struct document_file* base, struct range_tree_node* node, file_offset_t* budget) {
+  if (range_tree_node_summarized(node)) {
+    return 1;
+  }
+
+  if (node->inserter&TIPPSE_INSERTER_LEAF) {
+    if (budget) {
+      // Pages still being indexed in the background are cheaper to wait for
+      file_offset_t cost = document_file_summary_cost(base, node);
+      if (*budget==0 || (cost>*budget && base->index && document_file_summary_index(base, node) && atomic_acquire_fileoffset_t(&base->index->done)<base->index->count)) {
+        return 0;
+      }
+
+      *budget = (cost>*budget)?0:*budget-cost;
+    }
+
+    struct range_tree_node_visual* visual = range_tree_node_visual(node);
+    visual->lines = 0;
+    visual->characters = 0;
+    document_file_summary_scan(base, node, 0, node->length, &visual->lines, &visual->characters);
+    visual->summary_offset = node->offset;
+    visual->summary_length = node->length;
+    visual->summarized = 1;
+    return 1;
+  }
+
+  int left = document_file_summary_node(base, node->side[0], budget);
+  int right = document_file_summary_node(base, node->side[1], budget);
+  if (!left || !right) {
+    return 0;
+  }
+
+  document_file_summary_combine(node);
+  return 1;
+}
+
+// Continue building the summaries of the document, returns 1 if all nodes are summarized
+int document_file_summarize(struct document_file* base, file_offset_t budget) {
+  if (!document_file_summary_prepare(base) || !base->buffer.root) {
+    return 1;
+  }
+
+  range_tree_node_update_lazy(base->buffer.root, &base->buffer);
+  return document_file_summary_node(base, base->buffer.root, &budget);
+}
+
+// Number of newlines in the document if already summarized, FILE_OFFSET_T_MAX otherwise
+file_offset_t document_file_summary_lines(struct document_file* base) {
+  if (!document_file_summary_prepare(base)) {
+    return FILE_OFFSET_T_MAX;
+  }
+
+  if (!base->buffer.root) {
+    return 0;
+  }
+
+  range_tree_node_update_lazy(base->buffer.root, &base->buffer);
+  return range_tree_node_summarized(base->buffer.root)?range_tree_node_visual(base->buffer.root)->lines:FILE_OFFSET_T_MAX;
+}
+
 // Detect file properties
 void document_file_detect_properties(struct document_file* base) {
   if (!base->buffer.root) {
@@ -860,13 +1607,37 @@ void document_file_expand_all(struct document_file* base, file_offset_t offset,
   }
 }
 
+// Drop add buffer, the text stays alive as long as nodes reference it
+void document_file_append_release(struct document_file* base) {
+  if (base->append) {
+    fragment_seal(base->append);
+    fragment_dereference(base->append, NULL);
+    base->append = NULL;
+    base->append_length = 0;
+  }
+}
+
+// Insert text, small texts are appended to the add buffer and typing extends the previous node in place
 void document_file_insert(struct document_file* base, file_offset_t offset, const uint8_t* text, size_t length, int inserter) {
   if (offset>range_tree_length(&base->buffer)) {
     return;
   }
 
+  document_file_save_settle(base);
   file_offset_t old_length = range_tree_length(&base->buffer);
-  range_tree_insert_split(&base->buffer, offset, text, length, inserter);
+  if (length>=TIPPSE_DOCUMENT_APPEND_SIZE/2) {
+    range_tree_insert_split(&base->buffer, offset, text, length, inserter);
+  } else if (length>0) {
+    if (!base->append || base->append_length+length>TIPPSE_DOCUMENT_APPEND_SIZE) {
+      document_file_append_release(base);
+      base->append = fragment_create_append(TIPPSE_DOCUMENT_APPEND_SIZE);
+    }
+
+    memcpy(base->append->buffer+base->append_length, text, length);
+    range_tree_insert_extend(&base->buffer, offset, base->append, base->append_length, length, inserter);
+    base->append_length += length;
+  }
+
   length = range_tree_length(&base->buffer)-old_length;
   if (length<=0) {
     return;
@@ -901,6 +1672,7 @@ void document_file_insert_buffer(struct document_file* base, file_offset_t offse
     return;
   }
 
+  document_file_save_settle(base);
   range_tree_paste(&base->buffer, buffer, offset);
   document_undo_add(base, NULL, offset, length, TIPPSE_UNDO_TYPE_INSERT);
   document_file_expand_all(base, offset, length);
@@ -942,11 +1714,11 @@ void document_file_delete(struct document_file* base, file_offset_t offset, file
     return;
   }
 
-  document_undo_add(base, NULL, offset, length, TIPPSE_UNDO_TYPE_DELETE);
-
+  document_file_save_settle(base);
   file_offset_t old_length = range_tree_length(&base->buffer);
-  range_tree_delete(&base->buffer, offset, length, 0);
+  struct range_tree* removed = range_tree_cut(&base->buffer, offset, length);
   length = old_length-range_tree_length(&base->buffer);
+  document_undo_add_buffer(base, NULL, offset, length, TIPPSE_UNDO_TYPE_DELETE, removed);
 
   document_file_reduce_all(base, offset, length);
   document_undo_empty(base, base->redos);
@@ -985,12 +1757,11 @@ void document_file_move(struct document_file* base, file_offset_t from, file_off
     corrected -= length;
   }
 
-  struct range_tree* buffer_file = range_tree_copy(&base->buffer, from, length, &base->hook.callback);
-  document_undo_add(base, NULL, from, length, TIPPSE_UNDO_TYPE_DELETE);
-  range_tree_delete(&base->buffer, from, length, 0);
+  document_file_save_settle(base);
+  struct range_tree* buffer_file = range_tree_cut(&base->buffer, from, length);
   range_tree_paste(&base->buffer, buffer_file->root, corrected);
+  document_undo_add_buffer(base, NULL, from, length, TIPPSE_UNDO_TYPE_DELETE, buffer_file);
   document_undo_add(base, NULL, corrected, length, TIPPSE_UNDO_TYPE_INSERT);
-  range_tree_destroy(buffer_file);
 
   struct range_tree* buffer_bookmarks = range_tree_copy(&base->bookmarks, from, length, NULL);
   range_tree_delete(&base->bookmarks, from, length, 0);
@@ -1040,6 +1811,94 @@ void document_file_reset_views(struct document_file* base, int defaults) {
   }
 }
 
+// Stop the layout workers of all views, the pages, the file type or the configuration are going to change
+void document_file_cancel_views(struct document_file* base) {
+  struct list_node* views = base->views->first;
+  while (views) {
+    struct document_view* view = *(struct document_view**)list_object(views);
+    document_text_layout_cancel(view);
+
+    views = views->next;
+  }
+}
+
+// Join clean consecutive file pages far away from all views, only a limited number of pages is visited per call
+void document_file_coarsen(struct document_file* base) {
+  if (!base->buffer.root || !(base->buffer.root->inserter&TIPPSE_INSERTER_FILE)) {
+    return;
+  }
+
+  if (base->coarsen_offset>=range_tree_length(&base->buffer)) {
+    base->coarsen_offset = 0;
+  }
+
+  file_offset_t displacement;
+  struct range_tree_node* node = range_tree_find_offset(&base->buffer, base->coarsen_offset, &displacement);
+  file_offset_t offset = base->coarsen_offset-displacement;
+  for (size_t steps = 0; node && node->next && steps<TIPPSE_DOCUMENT_COARSEN_STEPS; steps++) {
+    struct range_tree_node* next = node->next;
+    if (node->inserter==next->inserter && !(node->inserter&TIPPSE_INSERTER_NOFUSE) && node->length+next->length<=TIPPSE_DOCUMENT_COARSEN_MAX && range_tree_node_consecutive(node, next) && !document_file_coarsen_viewed(base, offset, node->length+next->length) && document_file_coarsen_visuals(base, node, next)) {
+      document_file_save_settle(base);
+      range_tree_join(&base->buffer, node);
+      continue;
+    }
+
+    offset += node->length;
+    node = next;
+  }
+
+  base->coarsen_offset = (node && node->next)?offset:0;
+}
+
+// Check if range is near to the offset of any view
+int document_file_coarsen_viewed(struct document_file* base, file_offset_t offset, file_offset_t length) {
+  struct list_node* views = base->views->first;
+  while (views) {
+    struct document_view* view = *(struct document_view**)list_object(views);
+    file_offset_t low = (view->offset>TIPPSE_DOCUMENT_COARSEN_KEEP)?view->offset-TIPPSE_DOCUMENT_COARSEN_KEEP:0;
+    file_offset_t high = view->offset+TIPPSE_DOCUMENT_COARSEN_KEEP;
+    if (offset<high && offset+length>low) {
+      return 1;
+    }
+
+    views = views->next;
+  }
+
+  return 0;
+}
+
+// Combine visual information of two rendered neighbors into the first one, fails if any view has to render them again
+int document_file_coarsen_visuals(struct document_file* base, struct range_tree_node* first, struct range_tree_node* next) {
+  if (!(base->buffer.caps&TIPPSE_RANGETREE_CAPS_VISUAL)) {
+    return 1;
+  }
+
+  struct list_node* views = base->views->first;
+  while (views) {
+    struct document_view* view = *(struct document_view**)list_object(views);
+    if (document_view_visual_create(view, first, &base->buffer)->dirty || document_view_visual_create(view, next, &base->buffer)->dirty) {
+      return 0;
+    }
+
+    views = views->next;
+  }
+
+  views = base->views->first;
+  while (views) {
+    struct document_view* view = *(struct document_view**)list_object(views);
+    struct visual_info* visuals0 = document_view_visual_create(view, first, &base->buffer);
+    struct visual_info* visuals1 = document_view_visual_create(view, next, &base->buffer);
+    // The start state of the page is kept, the summary covers both pages
+    struct visual_info visuals = *visuals0;
+    visual_info_combine(view, &visuals, visuals0, visuals1);
+    *visuals0 = visuals;
+
+    views = views->next;
+  }
+
+  return 1;
+}
+
 // Invalidate node in all views
 void document_file_invalidate_view_node(struct document_file* base, struct range_tree_node* node, struct range_tree* tree) {
   struct list_node* views = base->views->first;
@@ -1080,6 +1939,7 @@ void document_file_reload_config(struct document_file* base) {
     return;
   }
 
+  document_file_cancel_views(base);
   config_clear(base->config);
 
   if (*base->filename) {
@@ -1196,6 +2056,8 @@ void document_file_reference_cache(struct document_file* base, struct file_cache
   struct document_file_cache* node = (struct document_file_cache*)list_object(list_insert_empty(base->caches, NULL));
   node->count = 1;
   node->cache = cache;
+  node->watch = (base->editor && base->editor->watch)?watch_add(base->editor->watch, cache->filename, 0):NULL;
+  node->modified = 0;
 }
 
 // Decrement reference counter and unlink cache if needed
@@ -1207,6 +2069,10 @@ void document_file_dereference_cache(struct document_file* base, struct file_cac
       node->count--;
       if (node->count==0) {
         // TODO: need global invalidation call to all document_file, document_undo and clipboards otherwise there might remain garbage/shifted data after including one file part into another
+        if (node->watch) {
+          watch_remove(base->editor->watch, node->watch);
+        }
+
         list_remove(base->caches, caches);
       }
 
@@ -1217,13 +2083,17 @@ void document_file_dereference_cache(struct document_file* base, struct file_cac
   }
 }
 
-// Check if one of the linked file caches has detected an update file
+// Check if one of the linked file caches has detected an update file, watched files are only checked after a change was signalled
 int document_file_modified_cache(struct document_file* base) {
   int modified = 0;
   struct list_node* caches = base->caches->first;
   while (caches) {
     struct document_file_cache* node = (struct document_file_cache*)list_object(caches);
-    modified |= file_cache_modified(node->cache);
+    if (!node->watch || watch_changed(node->watch) || file_cache_faulted(node->cache) || node->cache->detached) {
+      node->modified = file_cache_modified(node->cache);
+    }
+
+    modified |= node->modified;
     caches = caches->next;
   }
 
@@ -1232,6 +2102,7 @@ int document_file_modified_cache(struct document_file* base) {
 
 // A file cache is going to be removed
 void document_file_invalidate_cache(struct document_file* base, struct file_cache* cache) {
+  document_file_save_settle(base);
   range_tree_cache_invalidate(&base->buffer, cache);
 }
 
@@ -1255,6 +2126,7 @@ void document_file_fragment_dereference(struct range_tree_callback* base, struct
 void document_file_node_combine(struct range_tree_callback* base, struct range_tree_node* node, struct range_tree* tree) {
   struct range_tree_callback_hook* hook = (struct range_tree_callback_hook*)base;
   if ((tree->caps&TIPPSE_RANGETREE_CAPS_VISUAL)) {
+    document_file_summary_combine(node);
     document_file_combine_view_node(hook->file, node, tree);
   }
 }
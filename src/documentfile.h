@@ -19,7 +19,6 @@
 #include "library/rangetree.h"
 #include "library/thread.h"
 #include "library/mutex.h"
-#define TIPPSE_RANGETREE_CAPS_VISUAL (TIPPSE_RANGETREE_CAPS_USER<<0)
 
 struct range_tree_callback_hook {
   struct range_tree_callback callback;
@@ -28,6 +27,24 @@ struct range_tree_callback_hook {
 
 #define TIPPSE_DOCUMENT_MEMORY_LOADMAX 1024*1024
 #define TIPPSE_DOCUMENT_AUTO_LOADMAX 1024*16
+#define TIPPSE_DOCUMENT_APPEND_SIZE 1024*64
+#define TIPPSE_DOCUMENT_COARSEN_KEEP 1024*1024*4
+#define TIPPSE_DOCUMENT_COARSEN_MAX 1024*1024
+#define TIPPSE_DOCUMENT_COARSEN_STEPS 4096
+#define TIPPSE_DOCUMENT_INDEX_PAGE (1024*1024)
+#define TIPPSE_DOCUMENT_SUMMARY_STEP (1024*1024*4)
+
+// Rules the view independent node summaries are counted with
+#define TIPPSE_DOCUMENT_SUMMARY_NONE 0
+#define TIPPSE_DOCUMENT_SUMMARY_BYTE 1
+#define TIPPSE_DOCUMENT_SUMMARY_UTF8 2
+
+// Files are written and indexed by worker threads if the platform can wake up the editor from them
+#ifdef _EMSCRIPTEN
+#define TIPPSE_DOCUMENT_SAVE_THREAD 0
+#else
+#define TIPPSE_DOCUMENT_SAVE_THREAD 1
+#endif
 
 #define TIPPSE_TABSTOP_AUTO 0
 #define TIPPSE_TABSTOP_TAB 1
@@ -89,15 +106,60 @@ struct document_file_parser {
   struct file_type* (*constructor)(struct config* config, const char* file_type); // file type
 };
 
+// Changed range of a document that kept the length of its file, also the record header in the save journal
+struct document_file_patch {
+  file_offset_t offset;                 // position in document and file, FILE_OFFSET_T_MAX for the end record
+  file_offset_t length;                 // length of range, number of records for the end record
+};
+
+// Save of a document snapshot, the document itself may change meanwhile
+struct document_file_save {
+  struct document_file* file;           // document being saved
+  struct range_tree* snapshot;          // unmodifiable copy of the document buffer that is written, NULL until copied
+  struct range_tree_node* first;        // first leaf of the document buffer to copy from
+  struct mutex lock;                    // taken while the snapshot is copied
+  char* filename;                       // destination
+  char* tmpname;                        // temporary file replacing the destination when written
+  int success;                          // temporary file was written completely
+  int threaded;                         // written by a worker thread
+  file_offset_t finished;               // worker is done, accessed atomically
+  struct thread thread;                 // worker thread
+};
+
+// Summary of a page of the loaded file
+struct document_file_index_page {
+  file_offset_t lines;                  // newlines in page
+  file_offset_t characters;             // characters starting in page
+};
+
+// Line index of a loaded file built by a worker thread, only valid as long the document matches the file
+struct document_file_index {
+  struct document_file* file;           // document being indexed
+  struct file_cache* cache;             // file that is walked
+  struct encoding* encoding;            // decoder of the worker
+  codepoint_t newline;                  // codepoint ending a line
+  int mode;                             // pages are counted byte by byte unless TIPPSE_DOCUMENT_SUMMARY_NONE
+  struct document_file_index_page* pages; // summaries, filled in ascending order
+  size_t count;                         // number of pages
+  file_offset_t done;                   // pages summarized so far, accessed atomically
+  file_offset_t cancel;                 // worker should stop, accessed atomically
+  struct thread thread;                 // worker thread
+};
+
 struct document_file_cache {
   int count;                            // count of used fragments
   struct file_cache* cache;             // reference to cache
+  struct list_node* watch;              // change notification of the cached file, NULL if checked every time
+  int modified;                         // file was modified on last check
 };
 
 struct document_file {
   struct range_tree buffer;             // access to document buffer, root page
   struct file_cache* cache;             // base file cache that points directly to the selected file
   struct range_tree bookmarks;          // access to bookmarks
+  struct fragment* append;              // add buffer, inserted text is appended here
+  size_t append_length;                 // used bytes of add buffer
+  file_offset_t coarsen_offset;         // next page to check for coarsening
   struct list* undos;                   // undo information
   struct list* redos;                   // redo information
   struct file_type* type;               // file type
@@ -118,6 +180,11 @@ struct document_file {
   int save;                             // is real file?
   int save_skip;                        // user doesn't permit save?
   size_t undo_save_point;               // last save point in undo information
+  size_t undo_save_pending;             // save point of the snapshot that is being written
+  struct document_file_save* saving;    // save in progress, NULL if none
+  struct document_file_index* index;    // line index of the loaded file, NULL if none
+  int summary_mode;                     // counting rules of the node summaries
+  codepoint_t summary_newline;          // codepoint ending a line in the node summaries
 
   struct document_file_defaults defaults; // configuration
   int view_inactive;                    // last view in list is inactive
@@ -144,6 +211,8 @@ void document_file_pipe_operation_destroy(struct document_file_pipe_operation* b
 struct document_file* document_file_create(int save, int config, struct editor* editor);
 void document_file_clear(struct document_file* base, int all);
 void document_file_destroy(struct document_file* base);
+struct document_file* document_file_create_shadow(struct document_file* base, struct document_view* view, file_offset_t offset, file_offset_t length);
+void document_file_destroy_shadow(struct document_file* base);
 void document_file_name(struct document_file* base, const char* filename);
 void document_file_draft(struct document_file* base);
 int document_file_drafted(struct document_file* base);
@@ -156,9 +225,39 @@ void document_file_shutdown_pipe(struct document_file* base);
 void document_file_kill_pipe(struct document_file* base);
 void document_file_load(struct document_file* base, const char* filename, int reload, int reset);
 void document_file_load_memory(struct document_file* base, const uint8_t* buffer, size_t length, const char* name);
+int document_file_write(struct range_tree* buffer, const char* filename, struct editor* editor);
 int document_file_save_plain(struct document_file* base, const char* filename);
 int document_file_save(struct document_file* base, const char* filename);
+int document_file_save_begin(struct document_file* base, const char* filename);
+void document_file_save_entry(struct thread* thread);
+void document_file_save_snapshot(struct document_file_save* save);
+void document_file_save_settle(struct document_file* base);
+int document_file_save_finish(struct document_file* base, int wait);
+void document_file_rebind(struct document_file* base, const char* filename);
+void document_file_recache(struct document_file* base, const char* filename);
+int document_file_save_patch(struct document_file* base, const char* filename);
+file_offset_t document_file_patch_collect(struct document_file* base, struct list* patches);
+int document_file_patch_journal(struct document_file* base, struct list* patches, const char* journalname);
+int document_file_patch_overlap(struct document_file* base, struct list* patches);
+void document_file_patch_invalidate(struct document_file* base);
+int document_file_patch_write(struct document_file* base, const struct document_file_patch* patch, struct file_sink* sink);
+int document_file_journal_replay(const char* filename);
 void document_file_save_skip(struct document_file* base);
+void document_file_index_begin(struct document_file* base);
+void document_file_index_entry(struct thread* thread);
+void document_file_index_end(struct document_file* base);
+file_offset_t document_file_index_lines(struct document_file* base, int* complete);
+
+int document_file_summary_encoding(struct encoding* encoding);
+int document_file_summary_prepare(struct document_file* base);
+void document_file_summary_reset(struct range_tree_node* node);
+void document_file_summary_combine(struct range_tree_node* node);
+struct document_file_index* document_file_summary_index(struct document_file* base, struct range_tree_node* node);
+file_offset_t document_file_summary_cost(struct document_file* base, struct range_tree_node* node);
+void document_file_summary_scan(struct document_file* base, struct range_tree_node* node, file_offset_t offset, file_offset_t length, file_offset_t* lines, file_offset_t* characters);
+int document_file_summary_node(struct document_file* base, struct range_tree_node* node, file_offset_t* budget);
+int document_file_summarize(struct document_file* base, file_offset_t budget);
+file_offset_t document_file_summary_lines(struct document_file* base);
 
 void document_file_detect_properties(struct document_file* base);
 void document_file_detect_properties_stream(struct document_file* base, struct stream* document_stream);
@@ -167,6 +266,7 @@ void document_file_reload_config(struct document_file* base);
 
 void document_file_expand_all(struct document_file* base, file_offset_t offset, file_offset_t length);
 void document_file_expand(file_offset_t* pos, file_offset_t offset, file_offset_t length);
+void document_file_append_release(struct document_file* base);
 void document_file_insert(struct document_file* base, file_offset_t offset, const uint8_t* text, size_t length, int inserter);
 void document_file_insert_utf8(struct document_file* base, file_offset_t offset, const char* text, size_t length, int inserter);
 void document_file_insert_buffer(struct document_file* base, file_offset_t offset, struct range_tree_node* buffer);
@@ -181,6 +281,10 @@ void document_file_move(struct document_file* base, file_offset_t from, file_off
 
 void document_file_change_views(struct document_file* base, int defaults);
 void document_file_reset_views(struct document_file* base, int defaults);
+void document_file_cancel_views(struct document_file* base);
+void document_file_coarsen(struct document_file* base);
+int document_file_coarsen_viewed(struct document_file* base, file_offset_t offset, file_offset_t length);
+int document_file_coarsen_visuals(struct document_file* base, struct range_tree_node* first, struct range_tree_node* next);
 void document_file_invalidate_view_node(struct document_file* base, struct range_tree_node* node, struct range_tree* tree);
 void document_file_destroy_view_node(struct document_file* base, struct range_tree_node* node);
 void document_file_combine_view_node(struct document_file* base, struct range_tree_node* node, struct range_tree* tree);
@@ -0,0 +1,381 @@
+// Tippse - Document transaction - Collect many edits and apply them to the document in a single pass
+
+#include "documenttransaction.h"
+
+#include "documentfile.h"
+#include "documentundo.h"
+#include "documentview.h"
+#include "library/encoding.h"
+#include "library/encoding/utf8.h"
+#include "library/fragment.h"
+#include "library/stream.h"
+
+// Start empty transaction
+void document_transaction_create_inplace(struct document_transaction* base, struct document_file* file) {
+  base->file = file;
+  list_create_inplace(&base->operations, sizeof(struct document_transaction_operation));
+  base->last = NULL;
+  base->block = NULL;
+  base->block_length = 0;
+}
+
+// Drop all operations that were not committed
+void document_transaction_destroy_inplace(struct document_transaction* base) {
+  document_transaction_clear(base);
+  list_destroy_inplace(&base->operations);
+}
+
+// Remove all operations
+void document_transaction_clear(struct document_transaction* base) {
+  while (base->operations.first) {
+    free(((struct document_transaction_operation*)list_object(base->operations.first))->text);
+    list_remove(&base->operations, base->operations.first);
+  }
+
+  base->last = NULL;
+  free(base->block);
+  base->block = NULL;
+  base->block_length = 0;
+}
+
+// Queue replacement of a range, offsets are always given for the unmodified document and the text is owned afterwards
+void document_transaction_add(struct document_transaction* base, file_offset_t offset, file_offset_t length, uint8_t* text, size_t text_length) {
+  if (length==0 && text_length==0) {
+    free(text);
+    return;
+  }
+
+  // Search from the last operation, ascending and descending sequences are added in constant time
+  struct list_node* prev = base->last;
+  while (prev && ((struct document_transaction_operation*)list_object(prev))->offset>offset) {
+    prev = prev->prev;
+  }
+
+  struct list_node* next = prev?prev->next:base->operations.first;
+  while (next && ((struct document_transaction_operation*)list_object(next))->offset<=offset) {
+    prev = next;
+    next = next->next;
+  }
+
+  base->last = list_insert_empty(&base->operations, prev);
+  struct document_transaction_operation* operation = (struct document_transaction_operation*)list_object(base->last);
+  operation->offset = offset;
+  operation->length = length;
+  operation->text = text;
+  operation->text_length = text_length;
+}
+
+// Queue replacement of a range by a copy of the given text
+void document_transaction_replace(struct document_transaction* base, file_offset_t offset, file_offset_t length, const uint8_t* text, size_t text_length) {
+  uint8_t* copy = NULL;
+  if (text_length>0) {
+    copy = (uint8_t*)malloc(text_length);
+    memcpy(copy, text, text_length);
+  }
+
+  document_transaction_add(base, offset, length, copy, text_length);
+}
+
+// Queue replacement of a range by the content of a buffer
+void document_transaction_replace_buffer(struct document_transaction* base, file_offset_t offset, file_offset_t length, struct range_tree* buffer) {
+  file_offset_t text_length = range_tree_length(buffer);
+  document_transaction_add(base, offset, length, text_length?range_tree_raw(buffer, 0, text_length):NULL, (size_t)text_length);
+}
+
+// Queue insertion of utf8 text, the text is converted into the document encoding
+void document_transaction_insert_utf8(struct document_transaction* base, file_offset_t offset, const char* text, size_t length) {
+  size_t text_length = 0;
+  uint8_t* recoded = encoding_transform_plain((const uint8_t*)text, length, encoding_utf8_static(), base->file->encoding, &text_length);
+  document_transaction_add(base, offset, 0, recoded, text_length);
+}
+
+// Apply all operations in one sweep, close edits are rebuilt together and all positions are relocated once, returns 0 without any change if operations overlap
+int document_transaction_commit(struct document_transaction* base) {
+  struct document_file* file = base->file;
+  if (!base->operations.first) {
+    return 1;
+  }
+
+  // Operations must not overlap their predecessors or leave the document
+  file_offset_t length = range_tree_length(&file->buffer);
+  file_offset_t high = 0;
+  file_offset_t removed = 0;
+  file_offset_t inserted = 0;
+  struct list_node* node = base->operations.first;
+  while (node) {
+    struct document_transaction_operation* operation = (struct document_transaction_operation*)list_object(node);
+    if (operation->offset<high || operation->offset>length || operation->length>length-operation->offset) {
+      document_transaction_clear(base);
+      return 0;
+    }
+
+    high = operation->offset+operation->length;
+    removed += operation->length;
+    inserted += operation->text_length;
+    node = node->next;
+  }
+
+  document_undo_chain(file, file->undos);
+  document_file_save_settle(file);
+
+  // The whole transaction is one undo step, the removed leaves are collected with the untouched gaps between them
+  struct range_tree* original = NULL;
+  struct range_tree_build build;
+  if (file->undo) {
+    original = range_tree_create(&file->hook.callback, 0);
+    range_tree_build_begin(&build, original);
+  }
+
+  file_offset_t first = ((struct document_transaction_operation*)list_object(base->operations.first))->offset;
+  file_offset_t end = first;
+  file_offset_t shift = 0;
+  node = base->operations.first;
+  while (node) {
+    // Edits with short gaps are spliced as one range, longer untouched ranges keep their leaves and visual information
+    struct document_transaction_operation* operation = (struct document_transaction_operation*)list_object(node);
+    struct list_node* last = node;
+    file_offset_t low = operation->offset;
+    high = operation->offset+operation->length;
+    while (last->next) {
+      struct document_transaction_operation* next = (struct document_transaction_operation*)list_object(last->next);
+      if (next->offset-high>=TIPPSE_TRANSACTION_GAP_MIN) {
+        break;
+      }
+
+      last = last->next;
+      high = next->offset+next->length;
+    }
+
+    file_offset_t offset = low+shift;
+    if (original) {
+      range_tree_build_copy(&build, file->buffer.root, end, offset-end);
+    }
+
+    struct range_tree* cut = range_tree_cut(&file->buffer, offset, high-low);
+    struct stream stream;
+    if (cut->root) {
+      stream_from_page(&stream, range_tree_first(cut), 0);
+    }
+
+    struct range_tree* buffer = range_tree_create(&file->hook.callback, 0);
+    range_tree_build_begin(&base->build, buffer);
+    file_offset_t position = low;
+    while (1) {
+      operation = (struct document_transaction_operation*)list_object(node);
+      document_transaction_emit_stream(base, &stream, operation->offset-position);
+      if (operation->length>0) {
+        stream_forward(&stream, (size_t)operation->length);
+      }
+
+      document_transaction_emit_text(base, operation->text, operation->text_length);
+      position = operation->offset+operation->length;
+      if (node==last) {
+        break;
+      }
+
+      node = node->next;
+    }
+
+    document_transaction_flush(base);
+    range_tree_build_end(&base->build);
+    if (cut->root) {
+      stream_destroy(&stream);
+    }
+
+    file_offset_t replaced = range_tree_length(buffer);
+    if (buffer->root) {
+      range_tree_paste(&file->buffer, buffer->root, offset);
+    }
+
+    if (original) {
+      struct range_tree_node* leaf = range_tree_first(cut);
+      while (leaf) {
+        range_tree_build_take(&build, leaf);
+        leaf = range_tree_node_next(leaf);
+      }
+    }
+
+    range_tree_destroy(cut);
+    range_tree_destroy(buffer);
+    end = offset+replaced;
+    shift += replaced;
+    shift -= high-low;
+    node = node->next;
+  }
+
+  if (original) {
+    range_tree_build_end(&build);
+    document_undo_add_buffer(file, NULL, first, range_tree_length(original), TIPPSE_UNDO_TYPE_DELETE, original);
+    document_undo_add(file, NULL, first, end-first, TIPPSE_UNDO_TYPE_INSERT);
+  }
+
+  document_undo_chain(file, file->undos);
+
+  length = length-removed+inserted;
+  document_transaction_relocate_tree(base, &file->bookmarks, length);
+  document_transaction_relocate(base, &file->autocomplete_offset);
+
+  struct list_node* views = file->views->first;
+  while (views) {
+    struct document_view* view = *(struct document_view**)list_object(views);
+    document_transaction_relocate_tree(base, &view->selection, length);
+    document_transaction_relocate(base, &view->selection_end);
+    document_transaction_relocate(base, &view->selection_start);
+    document_transaction_relocate(base, &view->offset);
+
+    views = views->next;
+  }
+
+  document_undo_empty(file, file->redos);
+  document_transaction_clear(base);
+  return 1;
+}
+
+// Append collected small pieces as one fragment
+void document_transaction_flush(struct document_transaction* base) {
+  if (base->block_length==0) {
+    return;
+  }
+
+  struct fragment* buffer = fragment_create_memory(base->block, base->block_length);
+  range_tree_build_append(&base->build, buffer, 0, base->block_length, 0, 0, NULL);
+  fragment_dereference(buffer, NULL);
+  base->block = NULL;
+  base->block_length = 0;
+}
+
+// Append text to the collecting block
+void document_transaction_emit_text(struct document_transaction* base, const uint8_t* text, size_t length) {
+  while (length>0) {
+    if (!base->block) {
+      base->block = (uint8_t*)malloc(TREE_BLOCK_LENGTH_MIN);
+      base->block_length = 0;
+    }
+
+    size_t copy = TREE_BLOCK_LENGTH_MIN-base->block_length;
+    if (copy>length) {
+      copy = length;
+    }
+
+    memcpy(base->block+base->block_length, text, copy);
+    base->block_length += copy;
+    text += copy;
+    length -= copy;
+
+    if (base->block_length==TREE_BLOCK_LENGTH_MIN) {
+      document_transaction_flush(base);
+    }
+  }
+}
+
+// Append the next bytes of a stream
+void document_transaction_emit_stream(struct document_transaction* base, struct stream* stream, file_offset_t length) {
+  while (length>0) {
+    size_t segment = stream_cache_length(stream)-stream_displacement(stream);
+    if (segment==0) {
+      stream_next(stream);
+      continue;
+    }
+
+    if (segment>length) {
+      segment = (size_t)length;
+    }
+
+    document_transaction_emit_text(base, stream_buffer(stream), segment);
+    stream_forward(stream, segment);
+    length -= segment;
+  }
+}
+
+// Correct file offset by all operations, positions inside a replaced range move behind the new text
+void document_transaction_relocate(struct document_transaction* base, file_offset_t* pos) {
+  if (*pos==FILE_OFFSET_T_MAX) {
+    return;
+  }
+
+  file_offset_t removed = 0;
+  file_offset_t inserted = 0;
+  struct list_node* node = base->operations.first;
+  while (node) {
+    struct document_transaction_operation* operation = (struct document_transaction_operation*)list_object(node);
+    if (operation->offset>*pos) {
+      break;
+    }
+
+    if (*pos<=operation->offset+operation->length) {
+      *pos = operation->offset-removed+inserted+operation->text_length;
+      return;
+    }
+
+    removed += operation->length;
+    inserted += operation->text_length;
+    node = node->next;
+  }
+
+  *pos = *pos-removed+inserted;
+}
+
+// Rebuild marker tree with relocated boundaries, a boundary inside a replaced range moves to its start
+void document_transaction_relocate_tree(struct document_transaction* base, struct range_tree* tree, file_offset_t length) {
+  if (!tree->root) {
+    range_tree_resize(tree, length, 0);
+    return;
+  }
+
+  struct range_tree rebuilt;
+  range_tree_create_inplace(&rebuilt, tree->callback, tree->caps);
+  struct range_tree_build build;
+  range_tree_build_begin(&build, &rebuilt);
+
+  struct list_node* node = base->operations.first;
+  file_offset_t removed = 0;
+  file_offset_t inserted = 0;
+  file_offset_t boundary = 0;
+  file_offset_t start = 0;
+  struct range_tree_node* pending = NULL;
+  file_offset_t pending_length = 0;
+  struct range_tree_node* leaf = range_tree_node_first(tree->root);
+  while (leaf) {
+    boundary += leaf->length;
+    file_offset_t end = length;
+    if (leaf->next) {
+      struct document_transaction_operation* operation = node?(struct document_transaction_operation*)list_object(node):NULL;
+      while (operation && operation->offset+operation->length<boundary) {
+        removed += operation->length;
+        inserted += operation->text_length;
+        node = node->next;
+        operation = node?(struct document_transaction_operation*)list_object(node):NULL;
+      }
+
+      end = (operation && operation->offset<boundary)?operation->offset:boundary;
+      end = end-removed+inserted;
+      if (end<start) {
+        end = start;
+      }
+    }
+
+    if (end>start) {
+      if (pending && pending->inserter==leaf->inserter && (!(leaf->inserter&TIPPSE_INSERTER_NOFUSE) || pending->fuse_id==leaf->fuse_id)) {
+        pending_length += end-start;
+      } else {
+        if (pending) {
+          range_tree_build_append(&build, NULL, 0, pending_length, pending->inserter&~TIPPSE_INSERTER_LEAF, pending->fuse_id, pending->user_data);
+        }
+
+        pending = leaf;
+        pending_length = end-start;
+      }
+    }
+
+    start = end;
+    leaf = leaf->next;
+  }
+
+  if (pending) {
+    range_tree_build_append(&build, NULL, 0, pending_length, pending->inserter&~TIPPSE_INSERTER_LEAF, pending->fuse_id, pending->user_data);
+  }
+
+  range_tree_build_end(&build);
+  range_tree_destroy_inplace(tree);
+  *tree = rebuilt;
+}
@@ -0,0 +1,43 @@
+#ifndef TIPPSE_DOCUMENTTRANSACTION_H
+#define TIPPSE_DOCUMENTTRANSACTION_H
+
+#include <stdlib.h>
+#include "types.h"
+#include "library/list.h"
+#include "library/rangetree.h"
+
+// Edits closer than this are rebuilt as one range, their gaps are copied into shared blocks with the new text
+#define TIPPSE_TRANSACTION_GAP_MIN TREE_BLOCK_LENGTH_MIN
+
+struct document_transaction_operation {
+  file_offset_t offset;                 // offset of change in the unmodified document
+  file_offset_t length;                 // number of bytes to remove
+  uint8_t* text;                        // text to insert instead
+  size_t text_length;                   // length of text
+};
+
+struct document_transaction {
+  struct document_file* file;           // document to change
+  struct list operations;               // operations sorted by offset
+  struct list_node* last;               // last added operation, start of sorted insert
+  struct range_tree_build build;        // replacement for a range of close edits
+  uint8_t* block;                       // block collecting small pieces
+  size_t block_length;                  // bytes used in block
+};
+
+void document_transaction_create_inplace(struct document_transaction* base, struct document_file* file);
+void document_transaction_destroy_inplace(struct document_transaction* base);
+void document_transaction_add(struct document_transaction* base, file_offset_t offset, file_offset_t length, uint8_t* text, size_t text_length);
+void document_transaction_replace(struct document_transaction* base, file_offset_t offset, file_offset_t length, const uint8_t* text, size_t text_length);
+void document_transaction_replace_buffer(struct document_transaction* base, file_offset_t offset, file_offset_t length, struct range_tree* buffer);
+void document_transaction_insert_utf8(struct document_transaction* base, file_offset_t offset, const char* text, size_t length);
+int document_transaction_commit(struct document_transaction* base);
+void document_transaction_clear(struct document_transaction* base);
+
+void document_transaction_flush(struct document_transaction* base);
+void document_transaction_emit_text(struct document_transaction* base, const uint8_t* text, size_t length);
+void document_transaction_emit_stream(struct document_transaction* base, struct stream* stream, file_offset_t length);
+void document_transaction_relocate(struct document_transaction* base, file_offset_t* pos);
+void document_transaction_relocate_tree(struct document_transaction* base, struct range_tree* tree, file_offset_t length);
+
+#endif /* #ifndef TIPPSE_DOCUMENTTRANSACTION_H */
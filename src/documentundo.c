@@ -14,10 +14,23 @@ void document_undo_add(struct document_file* file, struct document_view* view, f
     return;
   }
 
+  document_undo_add_buffer(file, view, offset, length, type, range_tree_copy(&file->buffer, offset, length, &file->hook.callback));
+}
+
+// Add an undo step that owns the given buffer, deletes pass the leaves they removed from the document
+void document_undo_add_buffer(struct document_file* file, struct document_view* view, file_offset_t offset, file_offset_t length, int type, struct range_tree* buffer) {
+  if (length==0 || !file->undo) {
+    range_tree_destroy(buffer);
+    return;
+  }
+
   if ((type==TIPPSE_UNDO_TYPE_INSERT || type==TIPPSE_UNDO_TYPE_DELETE) && !file->autocomplete_rescan) {
     file->autocomplete_rescan = 1;
   }
 
+  // The snapshot being saved doesn't belong to a position in the undo list anymore, counts can be reached again with other content
+  file->undo_save_pending = SIZE_T_MAX;
+
   while (file->undos->count>TIPPSE_UNDO_MAX) {
     struct document_undo* undo = (struct document_undo*)list_object(file->undos->last);
     if (undo->buffer) {
@@ -25,18 +38,24 @@ void document_undo_add(struct document_file* file, struct document_view* view, f
     }
 
     list_remove(file->undos, file->undos->last);
-    if (file->undo_save_point>0) {
-      file->undo_save_point--;
-    } else {
-      file->undo_save_point = SIZE_T_MAX;
-    }
+    document_undo_shift_save_point(&file->undo_save_point);
+    document_undo_shift_save_point(&file->undo_save_pending);
   }
 
   struct document_undo* undo = (struct document_undo*)list_object(list_insert_empty(file->undos, NULL));
   undo->offset = offset;
   undo->length = length;
   undo->type = type;
-  undo->buffer = range_tree_copy(&file->buffer, offset, length, &file->hook.callback);
+  undo->buffer = buffer;
+}
+
+// Oldest undo step was dropped, move save point accordingly
+void document_undo_shift_save_point(size_t* save_point) {
+  if (*save_point>0) {
+    (*save_point)--;
+  } else {
+    *save_point = SIZE_T_MAX;
+  }
 }
 
 // Check if document modified
@@ -55,6 +74,10 @@ void document_undo_check_save_point(struct document_file* file) {
   if (file->undos->count+file->redos->count<file->undo_save_point) {
     file->undo_save_point = SIZE_T_MAX;
   }
+
+  if (file->undos->count+file->redos->count<file->undo_save_pending) {
+    file->undo_save_pending = SIZE_T_MAX;
+  }
 }
 
 // Set marker for a chain of undo steps
@@ -102,6 +125,11 @@ int document_undo_execute(struct document_file* file, struct document_view* view
 
   file_offset_t offset = 0;
   struct document_undo* undo = (struct document_undo*)list_object(node);
+  if (undo->type!=TIPPSE_UNDO_TYPE_CHAIN) {
+    file->undo_save_pending = SIZE_T_MAX;
+    document_file_save_settle(file);
+  }
+
   if (undo->type==TIPPSE_UNDO_TYPE_INSERT) {
     range_tree_delete(&file->buffer, undo->offset, undo->length, 0);
     offset = undo->offset;
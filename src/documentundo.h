@@ -19,8 +19,10 @@ struct document_undo {
 };
 
 void document_undo_add(struct document_file* file, struct document_view* view, file_offset_t offset, file_offset_t length, int insert);
+void document_undo_add_buffer(struct document_file* file, struct document_view* view, file_offset_t offset, file_offset_t length, int type, struct range_tree* buffer);
 void document_undo_mark_save_point(struct document_file* file);
 void document_undo_check_save_point(struct document_file* file);
+void document_undo_shift_save_point(size_t* save_point);
 int document_undo_modified(struct document_file* file);
 void document_undo_chain(struct document_file* file, struct list* list);
 void document_undo_empty(struct document_file* file, struct list* list);
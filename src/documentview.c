@@ -2,6 +2,7 @@
 
 #include "documentview.h"
 
+#include "document_text.h"
 #include "documentfile.h"
 #include "library/rangetree.h"
 
@@ -16,14 +17,16 @@ struct document_view* document_view_create(void) {
 
 // Create view inplace
 void document_view_create_inplace(struct document_view* base) {
-  range_tree_create_inplace(&base->selection, NULL, 0);
-  range_tree_create_inplace(&base->visuals, NULL, TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA);
+  range_tree_create_inplace(&base->selection, NULL, TIPPSE_RANGETREE_CAPS_SLIM);
+  range_tree_create_inplace(&base->visuals, NULL, TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA|TIPPSE_RANGETREE_CAPS_SLIM);
   range_tree_static(&base->visuals, FILE_OFFSET_T_MAX, 0);
   base->uid = document_view_uid++;
+  base->layout = NULL;
 }
 
 // Destroy view
 void document_view_destroy(struct document_view* base) {
+  document_text_layout_destroy(base);
   range_tree_destroy_inplace(&base->visuals);
   range_tree_destroy_inplace(&base->selection);
   free(base);
@@ -128,25 +131,26 @@ void document_view_select_invert(struct document_view* base, int update_search)
 // Allocate visual information
 struct visual_info* document_view_visual_create(struct document_view* base, struct range_tree_node* node, struct range_tree* tree) {
   range_tree_node_update_lazy(node, tree);
-  if (node->view_uid==base->uid) {
-    return node->visuals;
+  struct range_tree_node_visual* visual = range_tree_node_visual(node);
+  if (visual->view_uid==base->uid) {
+    return visual->visuals;
   }
 
   file_offset_t low = (file_offset_t)((size_t)node);
   file_offset_t diff;
   struct range_tree_node* location;
   if (range_tree_node_marked(base->visuals.root, low, 1, TIPPSE_INSERTER_MARK)) {
-    location = range_tree_node_find_offset(base->visuals.root, low, &diff);
+    location = range_tree_find_offset(&base->visuals, low, &diff);
   } else {
     range_tree_mark(&base->visuals, low, 1, TIPPSE_INSERTER_MARK|TIPPSE_INSERTER_NOFUSE);
-    location = range_tree_node_find_offset(base->visuals.root, low, &diff);
+    location = range_tree_find_offset(&base->visuals, low, &diff);
     location->user_data = malloc(sizeof(struct visual_info));
     visual_info_clear(base, (struct visual_info*)location->user_data);
   }
 
-  node->visuals = (struct visual_info*)location->user_data;
-  node->view_uid = base->uid;
-  return node->visuals;
+  visual->visuals = (struct visual_info*)location->user_data;
+  visual->view_uid = base->uid;
+  return visual->visuals;
 }
 
 // Deallocate visual information
@@ -156,8 +160,9 @@ void document_view_visual_destroy(struct document_view* base, struct range_tree_
     return;
   }
 
-  if (node->view_uid==base->uid) {
-    node->view_uid = 0;
+  struct range_tree_node_visual* visual = range_tree_node_visual(node);
+  if (visual->view_uid==base->uid) {
+    visual->view_uid = 0;
   }
 
   range_tree_mark(&base->visuals, low, 1, 0);
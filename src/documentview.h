@@ -43,6 +43,7 @@ struct document_view {
 
   int uid;                              // associated view uid for visual caching
   struct range_tree visuals;            // visualization index
+  struct document_text_layout* layout;  // layout of dirty pages in the background, NULL if never started
 };
 
 struct document_view* document_view_create(void);
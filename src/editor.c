@@ -19,6 +19,8 @@
 #include "splitter.h"
 #include "library/trie.h"
 #include "library/file.h"
+#include "library/filecache.h"
+#include "library/watch.h"
 
 // Documentation
 #include "../tmp/doc/index.h"
@@ -191,6 +193,8 @@ struct editor* editor_create(const char* base_path, struct screen* screen, int a
   struct editor* base = (struct editor*)malloc(sizeof(struct editor));
   base->close = 0;
   base->update_signal = update_signal;
+  base->watch = watch_create();
+  base->browser_watch = NULL;
   base->tasks = list_create(sizeof(struct editor_task));
   base->task_focus = NULL;
   base->task_stop = NULL;
@@ -221,6 +225,10 @@ struct editor* editor_create(const char* base_path, struct screen* screen, int a
 
   base->tabs_doc = document_file_create(0, 1, base);
   document_file_name(base->tabs_doc, "Open");
+  int64_t cache_size = config_convert_int64(config_find_ascii(base->tabs_doc->config, "/cache/size"));
+  if (cache_size>0) {
+    file_cache_budget((size_t)cache_size*1024*1024);
+  }
   base->tabs_doc->defaults.wrapping = 0;
   base->tabs_doc->line_select = 1;
   base->tabs_doc->undo = 0;
@@ -354,6 +362,13 @@ void editor_destroy(struct editor* base) {
     free(base->state);
   }
 
+  // Running saves are completed while the console is still there
+  struct list_node* it = base->documents->first;
+  while (it) {
+    document_file_save_finish(*(struct document_file**)list_object(it), 1);
+    it = it->next;
+  }
+
   splitter_destroy(base->splitters);
 
   while (base->documents->first) {
@@ -362,6 +377,11 @@ void editor_destroy(struct editor* base) {
   }
 
   list_destroy(base->documents);
+  if (base->browser_watch) {
+    watch_remove(base->watch, base->browser_watch);
+  }
+
+  watch_destroy(base->watch);
   editor_command_map_destroy(base);
 
   editor_menu_clear(base);
@@ -528,6 +548,7 @@ void editor_tick(struct editor* base) {
     while (doc) {
       struct document_file* file = *(struct document_file**)list_object(doc);
       document_undo_chain(file, file->undos);
+      document_file_coarsen(file);
       doc = doc->next;
     }
   }
@@ -549,9 +570,36 @@ void editor_tick(struct editor* base) {
 
   if (tick>base->tick_incremental) {
     base->tick_incremental = tick+tick_ms(100);
+    struct list_node* doc = base->documents->first;
+    while (doc) {
+      struct document_file* file = *(struct document_file**)list_object(doc);
+      document_file_summarize(file, TIPPSE_DOCUMENT_SUMMARY_STEP);
+      doc = doc->next;
+    }
+
     base->tick_message = tick_count();
     splitter_draw_multiple(base->splitters, base->screen, 1);
   }
+
+  if (watch_poll(base->watch)) {
+    editor_watch_update(base);
+  }
+}
+
+// Changes of watched files were signalled by the platform
+void editor_watch(struct editor* base) {
+  if (watch_process(base->watch)) {
+    editor_watch_update(base);
+  }
+}
+
+// React on changed files, the open browser shows the new directory listing
+void editor_watch_update(struct editor* base) {
+  if (base->browser_watch && watch_changed(base->browser_watch) && base->panel->file==base->browser_doc && (base->focus==base->panel || base->focus==base->filter)) {
+    editor_view_browser_refresh(base);
+  }
+
+  editor_draw(base);
 }
 
 // An input event was signalled ... translate it to a command if possible
@@ -1103,7 +1151,7 @@ int editor_open_selection(struct editor* base, struct splitter* node, struct spl
     if (node->document==node->document_text) {
       file_offset_t offset = document_text_line_start_offset(node->document, node->view, node->file);
       file_offset_t displacement;
-      struct range_tree_node* buffer = range_tree_node_find_offset(node->file->buffer.root, offset, &displacement);
+      struct range_tree_node* buffer = range_tree_find_offset(&node->file->buffer, offset, &displacement);
       struct stream text_stream;
       stream_from_page(&text_stream, buffer, displacement);
 
@@ -1464,10 +1512,34 @@ void editor_view_browser(struct editor* base, const char* filename, struct strea
 
   base->browser_type = type;
   base->browser_file = file;
+  struct list_node* browser_watch = watch_add(base->watch, base->browser_doc->filename, 1);
+  if (base->browser_watch) {
+    watch_remove(base->watch, base->browser_watch);
+  }
+
+  base->browser_watch = browser_watch;
   document_directory(base->browser_doc, filter_stream, filter_encoding, (predefined && *predefined)?predefined:base->browser_preset);
   editor_view_update(base, base->browser_doc);
 }
 
+// Read the browsed directory again, the filter is kept
+void editor_view_browser_refresh(struct editor* base) {
+  struct stream* filter_stream = NULL;
+  struct stream stream;
+  if (base->filter_doc->buffer.root) {
+    stream_from_page(&stream, range_tree_first(&base->filter_doc->buffer), 0);
+    filter_stream = &stream;
+  }
+
+  char* raw = (char*)range_tree_raw(&base->filter_doc->buffer, 0, range_tree_length(&base->filter_doc->buffer));
+  document_directory(base->browser_doc, filter_stream, base->filter_doc->encoding, (*raw)?raw:base->browser_preset);
+  editor_view_update(base, base->browser_doc);
+  free(raw);
+  if (filter_stream) {
+    stream_destroy(filter_stream);
+  }
+}
+
 // Update and change to document view
 void editor_view_tabs(struct editor* base, struct stream* filter_stream, struct encoding* filter_encoding) {
   if (!filter_stream) {
@@ -1816,7 +1888,12 @@ void editor_menu_append(struct editor* base, const char* title, int command, str
   entry->task.file = file;
 }
 
+// Show progress of a long running operation, documents laid out by worker threads have no editor
 void editor_process_message(struct editor* base, const char* message, file_offset_t position, file_offset_t length) {
+  if (!base) {
+    return;
+  }
+
   int64_t tick = tick_count();
   if (tick>base->tick_message+1000000 && base->focus && base->screen) {
     base->tick_message = tick;
@@ -2116,6 +2193,102 @@ void editor_state_load(struct editor* base, const char* filename) {
 }
 
 #ifdef _TESTSUITE
+// Record line, column, visual position and highlighting state at every stride of the document
+void editor_test_layout_positions(struct document_view* view, struct document_file* file, struct list* positions) {
+  file_offset_t length = range_tree_length(&file->buffer);
+  for (file_offset_t offset = 0; ; offset += 1021) {
+    if (offset>length) {
+      offset = length;
+    }
+
+    struct document_text_position in;
+    in.type = VISUAL_SEEK_OFFSET;
+    in.offset = offset;
+    in.clip = 0;
+    struct document_text_position out;
+    document_text_cursor_position(view, file, &in, &out, 0, 0);
+    list_insert(positions, positions->last, &out);
+    if (offset==length) {
+      break;
+    }
+  }
+}
+
+// Compare the positions of a layout with the reference and drop them, exit if they differ
+void editor_test_layout_compare(struct editor* base, struct list* positions, struct list* reference, const char* name) {
+  struct list_node* left = positions->first;
+  struct list_node* right = reference->first;
+  while (left && right) {
+    struct document_text_position* test = (struct document_text_position*)list_object(left);
+    struct document_text_position* main = (struct document_text_position*)list_object(right);
+    if (test->offset!=main->offset || test->line!=main->line || test->column!=main->column || test->x!=main->x || test->y!=main->y || test->visual_detail!=main->visual_detail) {
+      fprintf(stderr, "test layout of %s differs at offset %d: line %d/%d column %d/%d x %d/%d y %d/%d detail %x/%x (%s)\r\n", name, (int)main->offset, (int)test->line, (int)main->line, (int)test->column, (int)main->column, (int)test->x, (int)main->x, (int)test->y, (int)main->y, (unsigned int)test->visual_detail, (unsigned int)main->visual_detail, base->test_script_path);
+      exit(1);
+    }
+
+    left = left->next;
+    right = right->next;
+  }
+
+  while (positions->first) {
+    list_remove(positions, positions->first);
+  }
+
+  list_destroy(positions);
+}
+
+// Lay out the document of the active panel with the workers, on the main thread and with the unicode sequencer only, exit if the positions differ
+void editor_test_layout(struct editor* base, int processors) {
+  struct document_view* view = base->document->view;
+  struct document_file* file = base->document->file;
+  if (!file->buffer.root || base->document->document!=base->document->document_text) {
+    return;
+  }
+
+  // The first update creates the layout of the view, restart it with the requested number of segments
+  document_view_visual_clear(view);
+  if (document_text_layout_update(view, file)) {
+    document_text_layout_cancel(view);
+    if (processors>0) {
+      view->layout->processors = processors;
+    }
+  }
+
+  document_view_visual_clear(view);
+  while (1) {
+    (*base->document->document->incremental_update)(base->document->document, view, file);
+    struct visual_info* visuals = document_view_visual_create(view, file->buffer.root, &file->buffer);
+    if (!visuals->dirty && (!view->layout || !view->layout->count)) {
+      break;
+    }
+  }
+
+  struct list* workers = list_create(sizeof(struct document_text_position));
+  editor_test_layout_positions(view, file, workers);
+
+  // Without visual information the cursor positioning lays out the pages itself
+  document_text_layout_cancel(view);
+  document_view_visual_clear(view);
+  struct list* synchronous = list_create(sizeof(struct document_text_position));
+  editor_test_layout_positions(view, file, synchronous);
+
+  document_view_visual_clear(view);
+  document_text_ascii_path = 0;
+  struct list* sequencer = list_create(sizeof(struct document_text_position));
+  editor_test_layout_positions(view, file, sequencer);
+  document_text_ascii_path = 1;
+  document_view_visual_clear(view);
+
+  editor_test_layout_compare(base, workers, synchronous, "workers");
+  editor_test_layout_compare(base, sequencer, synchronous, "unicode sequencer");
+
+  while (synchronous->first) {
+    list_remove(synchronous, synchronous->first);
+  }
+
+  list_destroy(synchronous);
+}
+
 void editor_test_read(struct editor* base) {
   size_t count = 0;
   char buffer[1024*10+1];
@@ -2174,6 +2347,16 @@ void editor_test_read(struct editor* base) {
           editor_task_append(base, 3, editor_commands[check].value, NULL, 0, 0, 0, 0, 0, 0, NULL);
         }
       }
+    } else if (strcmp(params[0], "file")==0 && count>=3) {
+      // Rewrite an existing file in place like another program would
+      struct file* file = file_create(params[1], TIPPSE_FILE_WRITE|TIPPSE_FILE_TRUNCATE);
+      if (file) {
+        file_write(file, params[2], strlen(params[2]));
+        file_destroy(file);
+      }
+    } else if (strcmp(params[0], "layout")==0 && count>=2) {
+      editor_task_dispatch(base);
+      editor_test_layout(base, (int)strtol(params[1], NULL, 0));
     }
   }
 
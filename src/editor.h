@@ -239,6 +239,9 @@ struct editor {
   int browser_type;                   // Type of current file browser
   char* browser_preset;               // Text for filter preset
   struct document_file* browser_file; // Current file assigned to browser
+  struct list_node* browser_watch;    // Change notification of the browsed directory
+
+  struct watch* watch;                // Changes of open files and the browsed directory
 
   int document_draft_count;           // Counter for new documents
 
@@ -264,6 +267,8 @@ void editor_destroy(struct editor* base);
 void editor_closed(struct editor* base);
 void editor_draw(struct editor* base);
 void editor_tick(struct editor* base);
+void editor_watch(struct editor* base);
+void editor_watch_update(struct editor* base);
 void editor_keypress(struct editor* base, int key, codepoint_t cp, int button, int button_old, int x, int y);
 void editor_intercept(struct editor* base, int command, struct config_command* arguments, int key, codepoint_t cp, int button, int button_old, int x, int y, struct document_file* file);
 
@@ -291,6 +296,7 @@ int editor_modified_documents(struct editor* base);
 void editor_close_document(struct editor* base, struct document_file* file);
 void editor_panel_assign(struct editor* base, struct document_file* file);
 void editor_view_browser(struct editor* base, const char* filename, struct stream* filter_stream, struct encoding* filter_encoding, int type, const char* preset, char* predefined, struct document_file* file);
+void editor_view_browser_refresh(struct editor* base);
 void editor_view_tabs(struct editor* base, struct stream* filter_stream, struct encoding* filter_encoding);
 void editor_view_commands(struct editor* base, struct stream* filter_stream, struct encoding* filter_encoding);
 void editor_view_menu(struct editor* base, struct stream* filter_stream, struct encoding* filter_encoding);
@@ -329,6 +335,9 @@ void editor_state_save(struct editor* base, const char* filename);
 void editor_state_load(struct editor* base, const char* filename);
 
 #ifdef _TESTSUITE
+void editor_test_layout_positions(struct document_view* view, struct document_file* file, struct list* positions);
+void editor_test_layout_compare(struct editor* base, struct list* positions, struct list* reference, const char* name);
+void editor_test_layout(struct editor* base, int processors);
 void editor_test_read(struct editor* base);
 #endif
 
@@ -28,4 +28,45 @@ TIPPSE_INLINE file_offset_t atomic_decrement_fileoffset_t(file_offset_t* ptr) {
 #endif
 }
 
+TIPPSE_INLINE file_offset_t atomic_get_fileoffset_t(file_offset_t* ptr) {
+#ifdef _WINDOWS
+  return (file_offset_t)InterlockedCompareExchange64((int64_t*)ptr, 0, 0);
+#elif _TINYC_
+  return *ptr;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+#endif
+}
+
+TIPPSE_INLINE void atomic_release_fileoffset_t(file_offset_t* ptr, file_offset_t value) {
+#ifdef _WINDOWS
+  InterlockedExchange64((int64_t*)ptr, (int64_t)value);
+#elif _TINYC_
+  *ptr = value;
+#else
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+TIPPSE_INLINE file_offset_t atomic_acquire_fileoffset_t(file_offset_t* ptr) {
+#ifdef _WINDOWS
+  return (file_offset_t)InterlockedCompareExchange64((int64_t*)ptr, 0, 0);
+#elif _TINYC_
+  return *ptr;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+TIPPSE_INLINE int64_t atomic_increment_int64_t(int64_t* ptr) {
+#ifdef _WINDOWS
+  return (int64_t)InterlockedIncrement64(ptr);
+#elif _TINYC_
+  *ptr = (*ptr)+1;
+  return *ptr;
+#else
+  return __atomic_add_fetch(ptr, 1, __ATOMIC_RELAXED);
+#endif
+}
+
 #endif /* #ifndef TIPPSE_ATOMIC_H */
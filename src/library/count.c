@@ -0,0 +1,279 @@
+// Tippse - Count - Bulk counting of newlines, UTF-8 characters and ASCII spans in memory
+
+#include "count.h"
+
+static size_t (*count_bytes_kernel)(const uint8_t* buffer, size_t length, uint8_t value) = count_bytes_scalar;
+static size_t (*count_utf8_kernel)(const uint8_t* buffer, size_t length) = count_utf8_scalar;
+static size_t (*count_ascii_kernel)(const uint8_t* buffer, size_t length) = count_ascii_scalar;
+static size_t (*count_printable_kernel)(const uint8_t* buffer, size_t length) = count_printable_scalar;
+static const char* count_names[COUNT_KERNEL_MAX] = {"scalar", "SSE2", "AVX2"};
+
+// Select the fastest kernels of the processor
+void count_init(void) {
+  count_select(COUNT_KERNEL_MAX-1);
+}
+
+// Select kernels up to the given level, returns the level that is supported by the processor
+int count_select(int kernel) {
+#if COUNT_X86
+  __builtin_cpu_init();
+  if (kernel>=COUNT_KERNEL_AVX2 && __builtin_cpu_supports("avx2")) {
+    count_bytes_kernel = count_bytes_avx2;
+    count_utf8_kernel = count_utf8_avx2;
+    count_ascii_kernel = count_ascii_avx2;
+    count_printable_kernel = count_printable_avx2;
+    return COUNT_KERNEL_AVX2;
+  }
+
+  if (kernel>=COUNT_KERNEL_SSE2 && __builtin_cpu_supports("sse2")) {
+    count_bytes_kernel = count_bytes_sse2;
+    count_utf8_kernel = count_utf8_sse2;
+    count_ascii_kernel = count_ascii_sse2;
+    count_printable_kernel = count_printable_sse2;
+    return COUNT_KERNEL_SSE2;
+  }
+#endif
+
+  count_bytes_kernel = count_bytes_scalar;
+  count_utf8_kernel = count_utf8_scalar;
+  count_ascii_kernel = count_ascii_scalar;
+  count_printable_kernel = count_printable_scalar;
+  return COUNT_KERNEL_SCALAR;
+}
+
+// Name of kernel level
+const char* count_name(int kernel) {
+  return count_names[kernel];
+}
+
+// Number of bytes with the given value
+size_t count_bytes(const uint8_t* buffer, size_t length, uint8_t value) {
+  return (*count_bytes_kernel)(buffer, length, value);
+}
+
+// Number of UTF-8 characters, every byte that is not a continuation byte starts one
+size_t count_utf8(const uint8_t* buffer, size_t length) {
+  return (*count_utf8_kernel)(buffer, length);
+}
+
+// Length of the span that only contains ASCII characters
+size_t count_ascii(const uint8_t* buffer, size_t length) {
+  return (*count_ascii_kernel)(buffer, length);
+}
+
+// Length of the span that only contains printable ASCII characters, tabs and line feeds
+size_t count_printable(const uint8_t* buffer, size_t length) {
+  return (*count_printable_kernel)(buffer, length);
+}
+
+// Count bytes one by one
+size_t count_bytes_scalar(const uint8_t* buffer, size_t length, uint8_t value) {
+  size_t count = 0;
+  for (size_t pos = 0; pos<length; pos++) {
+    count += (buffer[pos]==value)?1:0;
+  }
+
+  return count;
+}
+
+// Count UTF-8 characters one by one
+size_t count_utf8_scalar(const uint8_t* buffer, size_t length) {
+  size_t count = 0;
+  for (size_t pos = 0; pos<length; pos++) {
+    count += ((buffer[pos]&0xc0)!=0x80)?1:0;
+  }
+
+  return count;
+}
+
+// Search first non ASCII byte one by one
+size_t count_ascii_scalar(const uint8_t* buffer, size_t length) {
+  size_t pos = 0;
+  while (pos<length && buffer[pos]<0x80) {
+    pos++;
+  }
+
+  return pos;
+}
+
+// Search first byte that isn't printable ASCII, tab or line feed one by one
+size_t count_printable_scalar(const uint8_t* buffer, size_t length) {
+  size_t pos = 0;
+  while (pos<length && ((buffer[pos]>=0x20 && buffer[pos]<0x7f) || buffer[pos]=='\t' || buffer[pos]=='\n')) {
+    pos++;
+  }
+
+  return pos;
+}
+
+#if COUNT_X86
+// Count bytes 16 at once, per byte counters are summed up before they can overflow
+__attribute__((target("sse2"))) size_t count_bytes_sse2(const uint8_t* buffer, size_t length, uint8_t value) {
+  __m128i match = _mm_set1_epi8((char)value);
+  __m128i total = _mm_setzero_si128();
+  size_t pos = 0;
+  while (length-pos>=16) {
+    size_t rounds = (length-pos)/16;
+    if (rounds>255) {
+      rounds = 255;
+    }
+
+    __m128i partial = _mm_setzero_si128();
+    for (size_t round = 0; round<rounds; round++, pos += 16) {
+      partial = _mm_sub_epi8(partial, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buffer+pos)), match));
+    }
+
+    total = _mm_add_epi64(total, _mm_sad_epu8(partial, _mm_setzero_si128()));
+  }
+
+  uint64_t sums[2];
+  _mm_storeu_si128((__m128i*)&sums[0], total);
+  return (size_t)(sums[0]+sums[1])+count_bytes_scalar(buffer+pos, length-pos, value);
+}
+
+// Count UTF-8 characters 16 bytes at once, continuation bytes are the signed values below -64
+__attribute__((target("sse2"))) size_t count_utf8_sse2(const uint8_t* buffer, size_t length) {
+  __m128i continuation = _mm_set1_epi8(-65);
+  __m128i total = _mm_setzero_si128();
+  size_t pos = 0;
+  while (length-pos>=16) {
+    size_t rounds = (length-pos)/16;
+    if (rounds>255) {
+      rounds = 255;
+    }
+
+    __m128i partial = _mm_setzero_si128();
+    for (size_t round = 0; round<rounds; round++, pos += 16) {
+      partial = _mm_sub_epi8(partial, _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i*)(buffer+pos)), continuation));
+    }
+
+    total = _mm_add_epi64(total, _mm_sad_epu8(partial, _mm_setzero_si128()));
+  }
+
+  uint64_t sums[2];
+  _mm_storeu_si128((__m128i*)&sums[0], total);
+  return (size_t)(sums[0]+sums[1])+count_utf8_scalar(buffer+pos, length-pos);
+}
+
+// Search first non ASCII byte 16 bytes at once
+__attribute__((target("sse2"))) size_t count_ascii_sse2(const uint8_t* buffer, size_t length) {
+  size_t pos = 0;
+  while (length-pos>=16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(buffer+pos)));
+    if (mask) {
+      return pos+(size_t)__builtin_ctz((unsigned int)mask);
+    }
+
+    pos += 16;
+  }
+
+  return pos+count_ascii_scalar(buffer+pos, length-pos);
+}
+
+// Search first byte that isn't printable ASCII, tab or line feed 16 bytes at once, bytes above 0x7f are negative in the signed compare
+__attribute__((target("sse2"))) size_t count_printable_sse2(const uint8_t* buffer, size_t length) {
+  __m128i low = _mm_set1_epi8(0x1f);
+  __m128i high = _mm_set1_epi8(0x7f);
+  __m128i tab = _mm_set1_epi8('\t');
+  __m128i newline = _mm_set1_epi8('\n');
+  size_t pos = 0;
+  while (length-pos>=16) {
+    __m128i data = _mm_loadu_si128((const __m128i*)(buffer+pos));
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(data, low), _mm_cmplt_epi8(data, high));
+    __m128i accepted = _mm_or_si128(printable, _mm_or_si128(_mm_cmpeq_epi8(data, tab), _mm_cmpeq_epi8(data, newline)));
+    int mask = _mm_movemask_epi8(accepted)^0xffff;
+    if (mask) {
+      return pos+(size_t)__builtin_ctz((unsigned int)mask);
+    }
+
+    pos += 16;
+  }
+
+  return pos+count_printable_scalar(buffer+pos, length-pos);
+}
+
+// Count bytes 32 at once
+__attribute__((target("avx2"))) size_t count_bytes_avx2(const uint8_t* buffer, size_t length, uint8_t value) {
+  __m256i match = _mm256_set1_epi8((char)value);
+  __m256i total = _mm256_setzero_si256();
+  size_t pos = 0;
+  while (length-pos>=32) {
+    size_t rounds = (length-pos)/32;
+    if (rounds>255) {
+      rounds = 255;
+    }
+
+    __m256i partial = _mm256_setzero_si256();
+    for (size_t round = 0; round<rounds; round++, pos += 32) {
+      partial = _mm256_sub_epi8(partial, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buffer+pos)), match));
+    }
+
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(partial, _mm256_setzero_si256()));
+  }
+
+  uint64_t sums[4];
+  _mm256_storeu_si256((__m256i*)&sums[0], total);
+  return (size_t)(sums[0]+sums[1]+sums[2]+sums[3])+count_bytes_scalar(buffer+pos, length-pos, value);
+}
+
+// Count UTF-8 characters 32 bytes at once
+__attribute__((target("avx2"))) size_t count_utf8_avx2(const uint8_t* buffer, size_t length) {
+  __m256i continuation = _mm256_set1_epi8(-65);
+  __m256i total = _mm256_setzero_si256();
+  size_t pos = 0;
+  while (length-pos>=32) {
+    size_t rounds = (length-pos)/32;
+    if (rounds>255) {
+      rounds = 255;
+    }
+
+    __m256i partial = _mm256_setzero_si256();
+    for (size_t round = 0; round<rounds; round++, pos += 32) {
+      partial = _mm256_sub_epi8(partial, _mm256_cmpgt_epi8(_mm256_loadu_si256((const __m256i*)(buffer+pos)), continuation));
+    }
+
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(partial, _mm256_setzero_si256()));
+  }
+
+  uint64_t sums[4];
+  _mm256_storeu_si256((__m256i*)&sums[0], total);
+  return (size_t)(sums[0]+sums[1]+sums[2]+sums[3])+count_utf8_scalar(buffer+pos, length-pos);
+}
+
+// Search first non ASCII byte 32 bytes at once
+__attribute__((target("avx2"))) size_t count_ascii_avx2(const uint8_t* buffer, size_t length) {
+  size_t pos = 0;
+  while (length-pos>=32) {
+    int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(buffer+pos)));
+    if (mask) {
+      return pos+(size_t)__builtin_ctz((unsigned int)mask);
+    }
+
+    pos += 32;
+  }
+
+  return pos+count_ascii_scalar(buffer+pos, length-pos);
+}
+
+// Search first byte that isn't printable ASCII, tab or line feed 32 bytes at once
+__attribute__((target("avx2"))) size_t count_printable_avx2(const uint8_t* buffer, size_t length) {
+  __m256i low = _mm256_set1_epi8(0x1f);
+  __m256i high = _mm256_set1_epi8(0x7f);
+  __m256i tab = _mm256_set1_epi8('\t');
+  __m256i newline = _mm256_set1_epi8('\n');
+  size_t pos = 0;
+  while (length-pos>=32) {
+    __m256i data = _mm256_loadu_si256((const __m256i*)(buffer+pos));
+    __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(data, low), _mm256_cmpgt_epi8(high, data));
+    __m256i accepted = _mm256_or_si256(printable, _mm256_or_si256(_mm256_cmpeq_epi8(data, tab), _mm256_cmpeq_epi8(data, newline)));
+    unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(accepted);
+    if (mask) {
+      return pos+(size_t)__builtin_ctz(mask);
+    }
+
+    pos += 32;
+  }
+
+  return pos+count_printable_scalar(buffer+pos, length-pos);
+}
+#endif
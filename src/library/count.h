@@ -0,0 +1,45 @@
+#ifndef TIPPSE_COUNT_H
+#define TIPPSE_COUNT_H
+
+#include <stdlib.h>
+#include "types.h"
+
+// Vector kernels are built for x86 by GCC compatible compilers and selected at runtime, other targets count byte by byte
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(_TINYC_)
+#define COUNT_X86 1
+#include <immintrin.h>
+#else
+#define COUNT_X86 0
+#endif
+
+#define COUNT_KERNEL_SCALAR 0
+#define COUNT_KERNEL_SSE2 1
+#define COUNT_KERNEL_AVX2 2
+#define COUNT_KERNEL_MAX 3
+
+void count_init(void);
+int count_select(int kernel);
+const char* count_name(int kernel);
+
+size_t count_bytes(const uint8_t* buffer, size_t length, uint8_t value);
+size_t count_utf8(const uint8_t* buffer, size_t length);
+size_t count_ascii(const uint8_t* buffer, size_t length);
+size_t count_printable(const uint8_t* buffer, size_t length);
+
+size_t count_bytes_scalar(const uint8_t* buffer, size_t length, uint8_t value);
+size_t count_utf8_scalar(const uint8_t* buffer, size_t length);
+size_t count_ascii_scalar(const uint8_t* buffer, size_t length);
+size_t count_printable_scalar(const uint8_t* buffer, size_t length);
+
+#if COUNT_X86
+size_t count_bytes_sse2(const uint8_t* buffer, size_t length, uint8_t value);
+size_t count_utf8_sse2(const uint8_t* buffer, size_t length);
+size_t count_ascii_sse2(const uint8_t* buffer, size_t length);
+size_t count_printable_sse2(const uint8_t* buffer, size_t length);
+size_t count_bytes_avx2(const uint8_t* buffer, size_t length, uint8_t value);
+size_t count_utf8_avx2(const uint8_t* buffer, size_t length);
+size_t count_ascii_avx2(const uint8_t* buffer, size_t length);
+size_t count_printable_avx2(const uint8_t* buffer, size_t length);
+#endif
+
+#endif /* #ifndef TIPPSE_COUNT_H */
@@ -3,6 +3,7 @@
 #include "encoding.h"
 #include "encoding/utf8.h"
 #include "encoding/native.h"
+#include "fragment.h"
 
 struct encoding* encoding_native_base = NULL;
 struct encoding* encoding_utf8_base = NULL;
@@ -57,19 +58,31 @@ void encoding_reverse_table_dereference(int* refs, uint16_t* referenced) {
 
 // sequence stream to different encoding
 struct range_tree* encoding_transform_stream(struct stream* stream, struct encoding* from, struct encoding* to, file_offset_t max) {
-  uint8_t recoded[1024];
+  uint8_t* recoded = NULL;
   size_t recode = 0;
 
   struct range_tree* root = range_tree_create(NULL, 0);
+  struct range_tree_build build;
+  range_tree_build_begin(&build, root);
   while (1) {
-    if (stream_end(stream) || recode>512 || max==0) {
-      range_tree_insert_split(root, range_tree_length(root), &recoded[0], recode, 0);
-      recode = 0;
+    if (stream_end(stream) || recode>TREE_BLOCK_LENGTH_MIN-512 || max==0) {
+      if (recode>0) {
+        struct fragment* fragment = fragment_create_memory(recoded, recode);
+        range_tree_build_append(&build, fragment, 0, recode, 0, 0, NULL);
+        fragment_dereference(fragment, NULL);
+        recoded = NULL;
+        recode = 0;
+      }
+
       if (stream_end(stream) || max==0) {
         break;
       }
     }
 
+    if (!recoded) {
+      recoded = (uint8_t*)malloc(TREE_BLOCK_LENGTH_MIN);
+    }
+
     size_t length;
     codepoint_t cp = from->decode(from, stream, &length);
     if (cp==UNICODE_CODEPOINT_BAD) {
@@ -77,13 +90,15 @@ struct range_tree* encoding_transform_stream(struct stream* stream, struct encod
     }
 
     if (max>=(file_offset_t)length) {
-      recode += to->encode(to, cp, &recoded[recode], sizeof(recoded)-recode);
+      recode += to->encode(to, cp, &recoded[recode], TREE_BLOCK_LENGTH_MIN-recode);
       max -= length;
     } else {
       max = 0;
     }
   }
 
+  free(recoded);
+  range_tree_build_end(&build);
   return root;
 }
 
@@ -93,6 +93,24 @@ size_t file_read(struct file* base, void* buffer, size_t length) {
 #endif
 }
 
+// Read from position without moving the file pointer, several threads may read concurrently
+size_t file_read_at(struct file* base, file_offset_t offset, void* buffer, size_t length) {
+#ifdef _WINDOWS
+  OVERLAPPED position;
+  memset(&position, 0, sizeof(position));
+  position.Offset = (DWORD)offset;
+  position.OffsetHigh = (DWORD)(offset>>32);
+  DWORD read;
+  if (!ReadFile(base->fd, buffer, (DWORD)length, &read, &position)) {
+    return 0;
+  }
+  return (size_t)read;
+#else
+  ssize_t ret = pread(base->fd, buffer, length, (off_t)offset);
+  return (ret>=0)?(size_t)ret:0;
+#endif
+}
+
 // Write to file
 size_t file_write(struct file* base, void* buffer, size_t length) {
 #ifdef _WINDOWS
@@ -107,6 +125,86 @@ size_t file_write(struct file* base, void* buffer, size_t length) {
 #endif
 }
 
+// Write to file at an absolute position without moving the file pointer
+size_t file_write_at(struct file* base, file_offset_t offset, const void* buffer, size_t length) {
+#ifdef _WINDOWS
+  OVERLAPPED position;
+  memset(&position, 0, sizeof(position));
+  position.Offset = (DWORD)offset;
+  position.OffsetHigh = (DWORD)(offset>>32);
+  DWORD written;
+  if (!WriteFile(base->fd, buffer, (DWORD)length, &written, &position)) {
+    return 0;
+  }
+  return (size_t)written;
+#else
+  ssize_t ret = pwrite(base->fd, buffer, length, (off_t)offset);
+  return (ret>=0)?(size_t)ret:0;
+#endif
+}
+
+// Wait until written data reached the disk
+int file_sync(struct file* base) {
+#ifdef _WINDOWS
+  return FlushFileBuffers(base->fd)?1:0;
+#else
+  return (fsync(base->fd)==0)?1:0;
+#endif
+}
+
+// Write many spans, the system is called once per TIPPSE_FILE_VECTOR_MAX spans if possible
+size_t file_write_vector(struct file* base, const struct file_vector* vectors, size_t count) {
+  size_t written = 0;
+#ifdef _WINDOWS
+  while (count>0) {
+    size_t length = file_write(base, (void*)vectors->buffer, vectors->length);
+    written += length;
+    if (length!=vectors->length) {
+      break;
+    }
+
+    vectors++;
+    count--;
+  }
+#else
+  struct iovec iov[TIPPSE_FILE_VECTOR_MAX];
+  while (count>0) {
+    size_t used = (count>TIPPSE_FILE_VECTOR_MAX)?TIPPSE_FILE_VECTOR_MAX:count;
+    for (size_t n = 0; n<used; n++) {
+      iov[n].iov_base = (void*)vectors[n].buffer;
+      iov[n].iov_len = vectors[n].length;
+    }
+
+    ssize_t ret = writev(base->fd, &iov[0], (int)used);
+    if (ret<=0) {
+      break;
+    }
+
+    written += (size_t)ret;
+    size_t done = (size_t)ret;
+    while (count>0 && done>=vectors->length) {
+      done -= vectors->length;
+      vectors++;
+      count--;
+    }
+
+    // Short write, finish the partially written span before the next batch
+    if (done>0) {
+      size_t left = vectors->length-done;
+      size_t length = file_write(base, (void*)((const uint8_t*)vectors->buffer+done), left);
+      written += length;
+      if (length!=left) {
+        break;
+      }
+
+      vectors++;
+      count--;
+    }
+  }
+#endif
+  return written;
+}
+
 file_offset_t file_seek(struct file* base, file_offset_t offset, int relative) {
 #ifdef _WINDOWS
   LONG low = (LONG)offset;
@@ -13,6 +13,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
 #endif
 
 #include "types.h"
@@ -22,6 +24,13 @@
 #define TIPPSE_FILE_READ 4
 #define TIPPSE_FILE_WRITE 8
 
+// Maximum number of spans handed to the system in a single vectored write
+#if !defined(_WINDOWS) && defined(IOV_MAX) && IOV_MAX<1024
+#define TIPPSE_FILE_VECTOR_MAX IOV_MAX
+#else
+#define TIPPSE_FILE_VECTOR_MAX 1024
+#endif
+
 #ifdef _WINDOWS
 #define TIPPSE_SEEK_CURRENT FILE_CURRENT
 #define TIPPSE_SEEK_START FILE_BEGIN
@@ -40,9 +49,18 @@ struct file {
 #endif
 };
 
+struct file_vector {
+  const void* buffer;  // start of span
+  size_t length;       // length of span
+};
+
 struct file* file_create(const char* path, int flags);
 size_t file_read(struct file* base, void* buffer, size_t length);
+size_t file_read_at(struct file* base, file_offset_t offset, void* buffer, size_t length);
 size_t file_write(struct file* base, void* buffer, size_t length);
+size_t file_write_at(struct file* base, file_offset_t offset, const void* buffer, size_t length);
+int file_sync(struct file* base);
+size_t file_write_vector(struct file* base, const struct file_vector* vectors, size_t count);
 file_offset_t file_seek(struct file* base, file_offset_t offset, int relative);
 void file_destroy(struct file* base);
 
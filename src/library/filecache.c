@@ -3,23 +3,84 @@
 #include "filecache.h"
 
 #include "file.h"
-#include "rangetree.h"
 #include "atomic.h"
 
 #define FILE_CACHE_DEBUG 0
 
+// All caches share one page budget, the registry is used to evict pages of other caches
+static struct file_cache* file_cache_first = NULL;
+static struct file_cache* file_cache_reclaim_next = NULL;
+static size_t file_cache_count = 0;
+static struct mutex file_cache_registry_lock;
+static file_offset_t file_cache_pages = 0;
+static file_offset_t file_cache_pages_max = FILE_CACHE_BUDGET/FILE_CACHE_PAGE_SIZE;
+
+#if FILE_CACHE_MAPPED
+static struct sigaction file_cache_fault_previous;
+static size_t file_cache_fault_page = 0;
+// Claimed under the registry lock, read by the bus error handler without it
+static struct file_cache_mapping file_cache_mappings[FILE_CACHE_MAPS];
+// Reads that are able to handle a vanished page of the current thread
+static __thread sigjmp_buf* volatile file_cache_fault_guard = NULL;
+#endif
+
+// Set up cache registry and the bus error handler for mapped files
+void file_cache_init(void) {
+  mutex_create_inplace(&file_cache_registry_lock);
+#if FILE_CACHE_MAPPED
+  file_cache_fault_page = (size_t)sysconf(_SC_PAGESIZE);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = file_cache_fault;
+  action.sa_flags = SA_SIGINFO|SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGBUS, &action, &file_cache_fault_previous);
+#endif
+}
+
+// Release cache registry
+void file_cache_free(void) {
+#if FILE_CACHE_MAPPED
+  sigaction(SIGBUS, &file_cache_fault_previous, NULL);
+#endif
+  mutex_destroy_inplace(&file_cache_registry_lock);
+}
+
+// Change the budget shared by all caches
+void file_cache_budget(size_t size) {
+  file_cache_pages_max = (file_offset_t)(size/FILE_CACHE_PAGE_SIZE);
+  if (file_cache_pages_max<FILE_CACHE_SHARDS) {
+    file_cache_pages_max = FILE_CACHE_SHARDS;
+  }
+}
+
 // Create file cache
 struct file_cache* file_cache_create(const char* filename) {
   struct file_cache* base = (struct file_cache*)malloc(sizeof(struct file_cache));
   base->filename = strdup(filename);
   base->fd = file_create(base->filename, TIPPSE_FILE_READ);
   base->count = 1;
-  range_tree_create_inplace(&base->index, NULL, 0);
-  list_create_inplace(&base->active, sizeof(struct file_cache_node));
-  list_create_inplace(&base->inactive, sizeof(struct file_cache_node));
-  base->size = 0;
-  base->max = FILE_CACHE_SIZE;
-  mutex_create_inplace(&base->lock);
+  for (size_t n = 0; n<FILE_CACHE_SHARDS; n++) {
+    struct file_cache_shard* shard = &base->shards[n];
+    shard->slots = (struct file_cache_slot*)calloc(FILE_CACHE_SLOTS, sizeof(struct file_cache_slot));
+    shard->slots_mask = FILE_CACHE_SLOTS-1;
+    shard->slots_used = 0;
+    list_create_inplace(&shard->active, sizeof(struct file_cache_node));
+    list_create_inplace(&shard->inactive, sizeof(struct file_cache_node));
+    shard->size = 0;
+    mutex_create_inplace(&shard->lock);
+  }
+  base->max = SIZE_T_MAX;
+  base->map = NULL;
+  base->map_length = 0;
+  base->mapping = NULL;
+  base->detached = 0;
+
+  mutex_lock(&file_cache_registry_lock);
+  base->next = file_cache_first;
+  file_cache_first = base;
+  file_cache_count++;
+  mutex_unlock(&file_cache_registry_lock);
 
   if (base->fd) {
 #ifdef _WINDOWS
@@ -28,7 +89,9 @@ struct file_cache* file_cache_create(const char* filename) {
     struct stat info;
     fstat(base->fd->fd, &info);
     base->modification_time = info.st_mtime;
+    base->map_length = (file_offset_t)info.st_size;
 #endif
+    file_cache_map(base);
   }
   return base;
 }
@@ -41,11 +104,27 @@ void file_cache_reference(struct file_cache* base) {
 // Decrease reference counter of file cache
 void file_cache_dereference(struct file_cache* base) {
   if (atomic_decrement_fileoffset_t(&base->count)==0) {
-    range_tree_destroy_inplace(&base->index);
-    mutex_destroy_inplace(&base->lock);
+    mutex_lock(&file_cache_registry_lock);
+    struct file_cache** prev = &file_cache_first;
+    while (*prev!=base) {
+      prev = &(*prev)->next;
+    }
+    *prev = base->next;
+    if (file_cache_reclaim_next==base) {
+      file_cache_reclaim_next = base->next;
+    }
+    file_cache_count--;
+    mutex_unlock(&file_cache_registry_lock);
 
-    file_cache_empty(base, &base->active);
-    file_cache_empty(base, &base->inactive);
+    for (size_t n = 0; n<FILE_CACHE_SHARDS; n++) {
+      struct file_cache_shard* shard = &base->shards[n];
+      free(shard->slots);
+      mutex_destroy_inplace(&shard->lock);
+
+      file_cache_empty(base, &shard->active);
+      file_cache_empty(base, &shard->inactive);
+    }
+    file_cache_unmap(base);
 
     if (base->fd) {
       file_destroy(base->fd);
@@ -60,107 +139,280 @@ void file_cache_dereference(struct file_cache* base) {
 void file_cache_empty(struct file_cache* base, struct list* nodes) {
   while (nodes->first) {
     struct file_cache_node* node = (struct file_cache_node*)list_object(nodes->first);
-    free(node->buffer);
+    if (!node->mapped) {
+      free(node->buffer);
+    }
     if (node->count!=0) {
       fprintf(stderr, "Hmm, a cached node is still in use! (%d-%llu) \r\n", (int)node->count, (long long unsigned int)node->offset);
     }
     list_remove(nodes, nodes->first);
+    atomic_decrement_fileoffset_t(&file_cache_pages);
   }
 }
 
-// Check if cache size is exhausted
-void file_cache_cleanup(struct file_cache* base) {
-  while (base->size>base->max && base->inactive.count>0) {
-    struct file_cache_node* node = (struct file_cache_node*)list_object(base->inactive.last);
-    if (node->count!=0) {
-      fprintf(stderr, "Hmm, a cached node is still in use in inactive list (%d-%llu)!\r\n", (int)node->count, (long long unsigned int)node->offset);
+// Look up cached page of the locked shard
+struct file_cache_node* file_cache_shard_find(struct file_cache_shard* shard, file_offset_t page) {
+  size_t slot = file_cache_slot(shard, page);
+  while (shard->slots[slot].node) {
+    if (shard->slots[slot].page==page) {
+      return shard->slots[slot].node;
+    }
+
+    slot = (slot+1)&shard->slots_mask;
+  }
+
+  return NULL;
+}
+
+// Add page to the table of the locked shard, the table is kept at most half filled
+void file_cache_shard_insert(struct file_cache_shard* shard, file_offset_t page, struct file_cache_node* node) {
+  if ((shard->slots_used+1)*2>shard->slots_mask+1) {
+    file_cache_shard_grow(shard);
+  }
+
+  size_t slot = file_cache_slot(shard, page);
+  while (shard->slots[slot].node) {
+    slot = (slot+1)&shard->slots_mask;
+  }
+
+  shard->slots[slot].page = page;
+  shard->slots[slot].node = node;
+  shard->slots_used++;
+}
+
+// Remove page from the table of the locked shard, following entries of the probe sequence are moved back to close the gap
+void file_cache_shard_remove(struct file_cache_shard* shard, file_offset_t page) {
+  size_t slot = file_cache_slot(shard, page);
+  while (shard->slots[slot].page!=page || !shard->slots[slot].node) {
+    if (!shard->slots[slot].node) {
+      return;
+    }
+
+    slot = (slot+1)&shard->slots_mask;
+  }
+
+  size_t gap = slot;
+  while (1) {
+    slot = (slot+1)&shard->slots_mask;
+    if (!shard->slots[slot].node) {
       break;
     }
 
-    if (FILE_CACHE_DEBUG) {
-      fprintf(stderr, "Remove %p %llx\r\n", node, (long long unsigned int)node->offset);
+    // Entries whose home lies cyclically within (gap, slot] have to stay
+    size_t home = file_cache_slot(shard, shard->slots[slot].page);
+    if (((slot-home)&shard->slots_mask)>=((slot-gap)&shard->slots_mask)) {
+      shard->slots[gap] = shard->slots[slot];
+      gap = slot;
+    }
+  }
+
+  shard->slots[gap].node = NULL;
+  shard->slots_used--;
+}
+
+// Double the table size of the locked shard
+void file_cache_shard_grow(struct file_cache_shard* shard) {
+  struct file_cache_slot* slots = shard->slots;
+  size_t count = shard->slots_mask+1;
+  shard->slots = (struct file_cache_slot*)calloc(count*2, sizeof(struct file_cache_slot));
+  shard->slots_mask = count*2-1;
+  shard->slots_used = 0;
+  for (size_t n = 0; n<count; n++) {
+    if (slots[n].node) {
+      file_cache_shard_insert(shard, slots[n].page, slots[n].node);
+    }
+  }
+
+  free(slots);
+}
+
+// Check if the shard's part of the cache size or the shared budget is exhausted
+void file_cache_cleanup(struct file_cache* base, struct file_cache_shard* shard) {
+  while (shard->size>base->max/FILE_CACHE_SHARDS || atomic_get_fileoffset_t(&file_cache_pages)>file_cache_pages_max) {
+    if (!file_cache_evict(base, shard)) {
+      break;
     }
+  }
+}
+
+// Drop least recently used inactive page of the locked shard
+int file_cache_evict(struct file_cache* base, struct file_cache_shard* shard) {
+  if (shard->inactive.count==0) {
+    return 0;
+  }
+
+  struct file_cache_node* node = (struct file_cache_node*)list_object(shard->inactive.last);
+  if (node->count!=0) {
+    fprintf(stderr, "Hmm, a cached node is still in use in inactive list (%d-%llu)!\r\n", (int)node->count, (long long unsigned int)node->offset);
+    return 0;
+  }
 
-    range_tree_mark(&base->index, node->offset, FILE_CACHE_PAGE_SIZE, 0);
+  if (FILE_CACHE_DEBUG) {
+    fprintf(stderr, "Remove %p %llx\r\n", node, (long long unsigned int)node->offset);
+  }
+
+  file_cache_shard_remove(shard, node->offset/FILE_CACHE_PAGE_SIZE);
+  if (!node->mapped) {
     free(node->buffer);
-    list_remove(&base->inactive, base->inactive.last);
-    base->size -= FILE_CACHE_PAGE_SIZE;
   }
+  list_remove(&shard->inactive, shard->inactive.last);
+  shard->size -= FILE_CACHE_PAGE_SIZE;
+  atomic_decrement_fileoffset_t(&file_cache_pages);
+  UNUSED(base);
+  return 1;
+}
+
+// Shared budget still exceeded, take inactive pages from the other caches in turn
+void file_cache_reclaim(struct file_cache* base) {
+  if (atomic_get_fileoffset_t(&file_cache_pages)<=file_cache_pages_max) {
+    return;
+  }
+
+  mutex_lock(&file_cache_registry_lock);
+  size_t idle = 0;
+  while (atomic_get_fileoffset_t(&file_cache_pages)>file_cache_pages_max && idle<=file_cache_count) {
+    struct file_cache* cache = file_cache_reclaim_next?file_cache_reclaim_next:file_cache_first;
+    file_cache_reclaim_next = cache->next;
+    int evicted = 0;
+    if (cache!=base) {
+      for (size_t n = 0; n<FILE_CACHE_SHARDS; n++) {
+        struct file_cache_shard* shard = &cache->shards[n];
+        if (mutex_trylock(&shard->lock)) {
+          evicted |= file_cache_evict(cache, shard);
+          mutex_unlock(&shard->lock);
+        }
+      }
+    }
+
+    idle = evicted?0:idle+1;
+  }
+  mutex_unlock(&file_cache_registry_lock);
 }
 
 // Create a reference (or valid buffer) to a cache
 struct file_cache_node* file_cache_invoke(struct file_cache* base, file_offset_t offset, size_t length, const uint8_t** buffer, size_t* buffer_length) {
   file_offset_t index = offset/FILE_CACHE_PAGE_SIZE;
   file_offset_t low = index*FILE_CACHE_PAGE_SIZE;
-  file_offset_t high = low+FILE_CACHE_PAGE_SIZE;
-  mutex_lock(&base->lock);
-  if (range_tree_length(&base->index)<high) {
-    range_tree_resize(&base->index, high, 0);
-  }
-
-  file_offset_t diff;
-  struct file_cache_node* node;
-  // TODO: optimize ... some parts are doing some work twice
-  if (range_tree_node_marked(base->index.root, low, high-low, TIPPSE_INSERTER_MARK)) {
-    struct range_tree_node* tree = range_tree_node_find_offset(base->index.root, low, &diff);
-    struct list_node* it = (struct list_node*)tree->user_data;
-    node = (struct file_cache_node*)list_object(it);
-    if (it!=base->active.first) {
+  struct file_cache_shard* shard = file_cache_shard(base, offset);
+  mutex_lock(&shard->lock);
+  struct file_cache_node* node = file_cache_shard_find(shard, index);
+  int faulted = file_cache_faulted(base);
+  if (node) {
+    struct list_node* it = node->list_node;
+    if (it!=shard->active.first) {
       if (node->count==0) {
-        list_remove_node(&base->inactive, it);
-        list_insert_node(&base->active, it, NULL);
+        list_remove_node(&shard->inactive, it);
+        list_insert_node(&shard->active, it, NULL);
       } else {
-        list_move(&base->active, it, NULL);
+        list_move(&shard->active, it, NULL);
       }
     }
     node->count++;
   } else {
-    range_tree_mark(&base->index, low, high-low, TIPPSE_INSERTER_MARK|TIPPSE_INSERTER_NOFUSE);
-    struct range_tree_node* tree = range_tree_node_find_offset(base->index.root, low, &diff);
-    tree->user_data = list_insert_empty(&base->active, NULL);
-    node = (struct file_cache_node*)list_object((struct list_node*)tree->user_data);
-    node->list_node = (struct list_node*)tree->user_data;
+    struct list_node* it = list_insert_empty(&shard->active, NULL);
+    node = (struct file_cache_node*)list_object(it);
+    node->list_node = it;
+    file_cache_shard_insert(shard, index, node);
     node->count = 1;
-    node->buffer = (uint8_t*)malloc(FILE_CACHE_PAGE_SIZE);
     node->offset = low;
     node->length = FILE_CACHE_PAGE_SIZE;
-    base->size += FILE_CACHE_PAGE_SIZE;
+    shard->size += FILE_CACHE_PAGE_SIZE;
+    atomic_increment_fileoffset_t(&file_cache_pages);
 
-    if (base->fd) {
-      file_seek(base->fd, low, TIPPSE_SEEK_START);
-      node->length = file_read(base->fd, node->buffer, FILE_CACHE_PAGE_SIZE);
-      if (FILE_CACHE_DEBUG) {
-        fprintf(stderr, "Read %p %llux %x\r\n", node, (long long unsigned int)low, (unsigned int)node->length);
+    if (base->map) {
+      // Point into the mapping, pages behind the mapped length appear empty like a short read would
+      node->mapped = 1;
+      node->buffer = base->map+((low<base->map_length)?low:base->map_length);
+      node->length = (low<base->map_length)?(size_t)((base->map_length-low<FILE_CACHE_PAGE_SIZE)?base->map_length-low:FILE_CACHE_PAGE_SIZE):0;
+      if (faulted) {
+        file_cache_read(base, node, node->length);
+      }
+    } else {
+      node->mapped = 0;
+      node->buffer = (uint8_t*)malloc(FILE_CACHE_PAGE_SIZE);
+      if (base->fd) {
+        node->length = file_read_at(base->fd, low, node->buffer, FILE_CACHE_PAGE_SIZE);
+        if (FILE_CACHE_DEBUG) {
+          fprintf(stderr, "Read %p %llux %x\r\n", node, (long long unsigned int)low, (unsigned int)node->length);
+        }
       }
     }
   }
 
-  file_cache_cleanup(base);
-  file_cache_debug(base);
-
   size_t displacement = offset%FILE_CACHE_PAGE_SIZE;
+#if FILE_CACHE_MAPPED
+  if (node->mapped && displacement<node->length) {
+    // The file may have been truncated since the page was mapped, a page nobody else reads is copied from the shorter file instead
+    size_t probe = node->length-displacement;
+    if (!file_cache_probe(node->buffer+displacement, (length<probe)?length:probe) && node->count==1) {
+      file_cache_read(base, node, node->length);
+    }
+  }
+#endif
+
+  file_cache_cleanup(base, shard);
+
   *buffer = node->buffer+displacement;
   *buffer_length = (displacement<=node->length)?node->length-displacement:0;
-  mutex_unlock(&base->lock);
+  mutex_unlock(&shard->lock);
+  file_cache_reclaim(base);
+  file_cache_debug(base);
   return node;
 }
 
+// Replace mapped page by a copy from the truncated file, the part that vanished reads as zeros since readers rely on the length they saw before
+void file_cache_read(struct file_cache* base, struct file_cache_node* node, size_t length) {
+  node->mapped = 0;
+  node->buffer = (uint8_t*)malloc(FILE_CACHE_PAGE_SIZE);
+  node->length = file_read_at(base->fd, node->offset, node->buffer, length);
+  memset(node->buffer+node->length, 0, length-node->length);
+  node->length = length;
+}
+
+// Ask the system to read a range asynchronously, the pages are resident as soon a sequential reader arrives
+void file_cache_prefetch(struct file_cache* base, file_offset_t offset, file_offset_t length) {
+#if FILE_CACHE_MAPPED
+  if (base->map) {
+    if (offset>=base->map_length) {
+      return;
+    }
+
+    if (length>base->map_length-offset) {
+      length = base->map_length-offset;
+    }
+
+    file_offset_t aligned = offset-(offset%FILE_CACHE_PAGE_SIZE);
+    madvise(base->map+aligned, (size_t)(offset+length-aligned), MADV_WILLNEED);
+    return;
+  }
+#endif
+#if defined(POSIX_FADV_WILLNEED)
+  if (base->fd) {
+    posix_fadvise(base->fd->fd, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+  }
+#else
+  UNUSED(base);
+  UNUSED(offset);
+  UNUSED(length);
+#endif
+}
+
 // Clone reference
 void file_cache_clone(struct file_cache* base, struct file_cache_node* node) {
-  mutex_lock(&base->lock);
+  struct file_cache_shard* shard = file_cache_shard(base, node->offset);
+  mutex_lock(&shard->lock);
   if (node->count==0) {
     fprintf(stderr, "Node to clone was not in use...");
     abort();
   }
   node->count++;
-
-  file_cache_debug(base);
-  mutex_unlock(&base->lock);
+  mutex_unlock(&shard->lock);
 }
 
 // Release reference
 void file_cache_revoke(struct file_cache* base, struct file_cache_node* node) {
-  mutex_lock(&base->lock);
+  struct file_cache_shard* shard = file_cache_shard(base, node->offset);
+  mutex_lock(&shard->lock);
   if (node->count==0) {
     fprintf(stderr, "Node count underflow!!! There's a serious problem.");
     abort();
@@ -169,16 +421,23 @@ void file_cache_revoke(struct file_cache* base, struct file_cache_node* node) {
   node->count--;
 
   if (node->count==0) {
-    list_remove_node(&base->active, node->list_node);
-    list_insert_node(&base->inactive, node->list_node, NULL);
+    list_remove_node(&shard->active, node->list_node);
+    list_insert_node(&shard->inactive, node->list_node, NULL);
   }
 
-  file_cache_debug(base);
-  mutex_unlock(&base->lock);
+  mutex_unlock(&shard->lock);
 }
 
 // The file was modified while it was open?
 int file_cache_modified(struct file_cache* base) {
+  if (file_cache_faulted(base)) {
+    return 1;
+  }
+
+  if (base->detached) {
+    return 0;
+  }
+
 #ifdef _WINDOWS
   FILETIME info;
   GetFileTime(base->fd->fd, NULL, NULL, &info);
@@ -190,19 +449,164 @@ int file_cache_modified(struct file_cache* base) {
 #endif
 }
 
+// Check if another cache reads the same file, its holders would see bytes written in place
+int file_cache_shared(struct file_cache* base) {
+  int shared = 0;
+  mutex_lock(&file_cache_registry_lock);
+  struct file_cache* cache = file_cache_first;
+  while (cache && !shared) {
+    shared = (cache!=base && !cache->detached && strcmp(cache->filename, base->filename)==0)?1:0;
+    cache = cache->next;
+  }
+
+  mutex_unlock(&file_cache_registry_lock);
+  return shared;
+}
+
+// File was replaced by renaming another one over it, the open descriptor or mapping keeps serving the old content
+// Only a rename protects the old content. MAP_PRIVATE copies pages on write from this process only, so changes made
+// in place by another writer (including an in place save of a document) still show through pages that were not read yet.
+// The editor doesn't patch a file in place while another cache reads it (see file_cache_shared) and invalidates all holders first.
+// Truncation by another writer is caught by file_cache_probe and reported through file_cache_faulted.
+void file_cache_detach(struct file_cache* base) {
+  base->detached = 1;
+}
+
+// Map the file if possible, otherwise pages are copied on demand
+void file_cache_map(struct file_cache* base) {
+#if FILE_CACHE_MAPPED
+  if (base->map_length==0 || base->map_length>FILE_CACHE_MAP_MAX) {
+    return;
+  }
+
+  mutex_lock(&file_cache_registry_lock);
+  struct file_cache_mapping* mapping = NULL;
+  for (size_t n = 0; n<FILE_CACHE_MAPS && !mapping; n++) {
+    if (atomic_get_fileoffset_t(&file_cache_mappings[n].end)==0) {
+      mapping = &file_cache_mappings[n];
+    }
+  }
+
+  void* map = mapping?mmap(NULL, (size_t)base->map_length, PROT_READ, MAP_PRIVATE, base->fd->fd, 0):MAP_FAILED;
+  if (map!=MAP_FAILED) {
+    // Range is published last, the handler never sees a partially filled slot
+    atomic_release_fileoffset_t(&mapping->faulted, 0);
+    atomic_release_fileoffset_t(&mapping->begin, (file_offset_t)(uintptr_t)map);
+    atomic_release_fileoffset_t(&mapping->end, (file_offset_t)(uintptr_t)map+base->map_length);
+    base->map = (uint8_t*)map;
+    base->mapping = mapping;
+    madvise(map, (size_t)base->map_length, MADV_SEQUENTIAL);
+  }
+  mutex_unlock(&file_cache_registry_lock);
+#endif
+}
+
+// Remove file mapping
+void file_cache_unmap(struct file_cache* base) {
+#if FILE_CACHE_MAPPED
+  if (!base->map) {
+    return;
+  }
+
+  mutex_lock(&file_cache_registry_lock);
+  atomic_release_fileoffset_t(&base->mapping->end, 0);
+  mutex_unlock(&file_cache_registry_lock);
+  munmap(base->map, (size_t)base->map_length);
+  base->map = NULL;
+  base->mapping = NULL;
+#endif
+}
+
+// Check if pages of the mapping vanished since the file was truncated by another writer
+int file_cache_faulted(struct file_cache* base) {
+#if FILE_CACHE_MAPPED
+  if (base->mapping && atomic_acquire_fileoffset_t(&base->mapping->faulted)) {
+    return 1;
+  }
+#else
+  UNUSED(base);
+#endif
+
+  return 0;
+}
+
+#if FILE_CACHE_MAPPED
+// Touch the system pages of a mapped range, returns zero if one of them vanished since the file was truncated
+int file_cache_probe(const uint8_t* buffer, size_t length) {
+  sigjmp_buf guard;
+  if (sigsetjmp(guard, 0)) {
+    // The mask is only restored here, saving it on every probe would cost a system call
+    sigset_t unblock;
+    sigemptyset(&unblock);
+    sigaddset(&unblock, SIGBUS);
+    pthread_sigmask(SIG_UNBLOCK, &unblock, NULL);
+    file_cache_fault_guard = NULL;
+    return 0;
+  }
+
+  file_cache_fault_guard = &guard;
+  const uint8_t* end = buffer+length;
+  for (const volatile uint8_t* page = buffer-((uintptr_t)buffer%file_cache_fault_page); page<end; page += file_cache_fault_page) {
+    (void)*page;
+  }
+
+  file_cache_fault_guard = NULL;
+  return 1;
+}
+
+// Bus error while reading a mapping, the file got shorter. The mapping is flagged, so the document reports an external
+// modification. Probing reads continue at their guard, other readers had their page removed after it was probed and
+// get a page of zeros as a last resort. mmap is no async signal safe function by the letter, it is a plain system call
+// on the systems mappings are used on though and the only way to let the interrupted read continue.
+void file_cache_fault(int signal, siginfo_t* info, void* context) {
+  file_offset_t address = (file_offset_t)(uintptr_t)info->si_addr;
+  for (size_t n = 0; n<FILE_CACHE_MAPS; n++) {
+    struct file_cache_mapping* mapping = &file_cache_mappings[n];
+    if (address<atomic_acquire_fileoffset_t(&mapping->end) && address>=atomic_acquire_fileoffset_t(&mapping->begin)) {
+      atomic_release_fileoffset_t(&mapping->faulted, 1);
+      if (file_cache_fault_guard) {
+        siglongjmp(*file_cache_fault_guard, 1);
+      }
+
+      uint8_t* page = (uint8_t*)(uintptr_t)(address-(address%file_cache_fault_page));
+      if (mmap(page, file_cache_fault_page, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0)!=MAP_FAILED) {
+        return;
+      }
+      break;
+    }
+  }
+
+  // Not caused by a mapping, restore previous behaviour and let the instruction fault again
+  sigaction(SIGBUS, &file_cache_fault_previous, NULL);
+  UNUSED(signal);
+  UNUSED(context);
+}
+#endif
+
 // Print cache debug information
 void file_cache_debug(struct file_cache* base) {
   if (FILE_CACHE_DEBUG) {
     file_offset_t count = 0;
+    size_t active = 0;
+    size_t inactive = 0;
+    size_t size = 0;
+    for (size_t n = 0; n<FILE_CACHE_SHARDS; n++) {
+      struct file_cache_shard* shard = &base->shards[n];
+      mutex_lock(&shard->lock);
+      struct list_node* it = shard->active.first;
+      while (it) {
+        struct file_cache_node* node = (struct file_cache_node*)list_object(it);
+        count += node->count;
 
-    struct list_node* it = base->active.first;
-    while (it) {
-      struct file_cache_node* node = (struct file_cache_node*)list_object(it);
-      count += node->count;
+        it = it->next;
+      }
 
-      it = it->next;
+      active += shard->active.count;
+      inactive += shard->inactive.count;
+      size += shard->size;
+      mutex_unlock(&shard->lock);
     }
 
-    fprintf(stderr, "FC '%s' %d+%d/%d & %d refs (%d/%d)\r\n", base->filename, (int)base->active.count, (int)base->inactive.count, (int)(base->active.count+base->inactive.count), (int)count, (int)base->size, (int)base->max);
+    fprintf(stderr, "FC '%s' %d+%d/%d & %d refs (%d/%d)\r\n", base->filename, (int)active, (int)inactive, (int)(active+inactive), (int)count, (int)size, (int)base->max);
   }
 }
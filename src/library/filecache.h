@@ -14,11 +14,34 @@
 #endif
 #include "types.h"
 
+// Files are mapped instead of copied page by page if the system supports it
+#if !defined(_WINDOWS) && !defined(_EMSCRIPTEN)
+#define FILE_CACHE_MAPPED 1
+#include <sys/mman.h>
+#include <signal.h>
+#include <setjmp.h>
+#else
+#define FILE_CACHE_MAPPED 0
+#endif
+
+// Largest file mapped at once, small address spaces fall back to copying for bigger files
+#define FILE_CACHE_MAP_MAX ((sizeof(void*)>=8)?(file_offset_t)1024*1024*1024*1024*64:(file_offset_t)1024*1024*256)
+// Number of mappings that can exist at once, further files are copied page by page
+#define FILE_CACHE_MAPS 256
+
 #include "list.h"
 
-// One megabyte of cache
+// One megabyte of cache for caches that must not take from the shared budget
 #define FILE_CACHE_PAGE_SIZE (65536)
 #define FILE_CACHE_SIZE (1024*1024)
+// Default of the budget shared by all caches
+#define FILE_CACHE_BUDGET (1024*1024*64)
+// Sequential readers ask the system for this much data in advance
+#define FILE_CACHE_PREFETCH (FILE_CACHE_PAGE_SIZE*64)
+// Pages are spread by page number over independently locked shards
+#define FILE_CACHE_SHARDS 8
+// Initial number of slots in the page table of a shard, must be a power of two
+#define FILE_CACHE_SLOTS 16
 
 struct file_cache_node {
   file_offset_t count;                      // number of references
@@ -26,11 +49,34 @@ struct file_cache_node {
   file_offset_t offset;                     // offset in file
   size_t length;                            // length of buffer
   struct list_node* list_node;              // node in list
+  int mapped;                               // buffer points into the file mapping
 };
 
-#include "rangetree.h"
 #include "mutex.h"
 
+// Slot in the open addressed page table
+struct file_cache_slot {
+  file_offset_t page;                       // page number in file
+  struct file_cache_node* node;             // cached page, NULL if slot is empty
+};
+
+struct file_cache_shard {
+  size_t size;                              // current shard size
+  struct file_cache_slot* slots;            // page table, linear probing
+  size_t slots_mask;                        // number of slots minus one
+  size_t slots_used;                        // number of filled slots
+  struct list active;                       // list of active nodes
+  struct list inactive;                     // lru list of inactive nodes
+  struct mutex lock;                        // shard lock
+};
+
+// Mapped address range as seen by the bus error handler, which can't take locks or follow cache pointers
+struct file_cache_mapping {
+  file_offset_t begin;                      // first address of mapping
+  file_offset_t end;                        // address after mapping, zero while the slot is free
+  file_offset_t faulted;                    // a page of the mapping vanished since the file was truncated
+};
+
 struct file_cache {
   char* filename;                           // name of file
   struct file* fd;                          // file descriptor
@@ -41,23 +87,55 @@ struct file_cache {
   time_t modification_time;                 // modification time of file during load
 #endif
 
-  size_t max;                               // maximum cache size
-  size_t size;                              // current cache size
-  struct range_tree index;                  // index
-  struct list active;                       // list of active nodes
-  struct list inactive;                     // lru list of inactive nodes
-  struct mutex lock;                        // whole cache lock
+  size_t max;                               // maximum cache size, the shared budget applies in addition
+  struct file_cache_shard shards[FILE_CACHE_SHARDS]; // pages by page number modulo shard count
+
+  uint8_t* map;                             // mapping of the whole file, NULL if pages are copied
+  file_offset_t map_length;                 // length of file during mapping
+  struct file_cache_mapping* mapping;       // published range of the mapping
+  int detached;                             // file name refers to another file now, the old content is still readable
+  struct file_cache* next;                  // next cache in registry of all caches
 };
 
+void file_cache_init(void);
+void file_cache_free(void);
+void file_cache_budget(size_t size);
 struct file_cache* file_cache_create(const char* filename);
 void file_cache_reference(struct file_cache* base);
 void file_cache_dereference(struct file_cache* base);
 int file_cache_modified(struct file_cache* base);
+int file_cache_shared(struct file_cache* base);
+void file_cache_detach(struct file_cache* base);
+void file_cache_map(struct file_cache* base);
+void file_cache_unmap(struct file_cache* base);
+int file_cache_faulted(struct file_cache* base);
+#if FILE_CACHE_MAPPED
+int file_cache_probe(const uint8_t* buffer, size_t length);
+void file_cache_fault(int signal, siginfo_t* info, void* context);
+#endif
 
 void file_cache_empty(struct file_cache* base, struct list* nodes);
-void file_cache_cleanup(struct file_cache* base);
+struct file_cache_node* file_cache_shard_find(struct file_cache_shard* shard, file_offset_t page);
+void file_cache_shard_insert(struct file_cache_shard* shard, file_offset_t page, struct file_cache_node* node);
+void file_cache_shard_remove(struct file_cache_shard* shard, file_offset_t page);
+void file_cache_shard_grow(struct file_cache_shard* shard);
+void file_cache_cleanup(struct file_cache* base, struct file_cache_shard* shard);
+int file_cache_evict(struct file_cache* base, struct file_cache_shard* shard);
+void file_cache_reclaim(struct file_cache* base);
+void file_cache_read(struct file_cache* base, struct file_cache_node* node, size_t length);
 struct file_cache_node* file_cache_invoke(struct file_cache* base, file_offset_t offset, size_t length, const uint8_t** buffer, size_t* buffer_length);
+void file_cache_prefetch(struct file_cache* base, file_offset_t offset, file_offset_t length);
 void file_cache_clone(struct file_cache* base, struct file_cache_node* node);
 void file_cache_revoke(struct file_cache* base, struct file_cache_node* node);
 void file_cache_debug(struct file_cache* base);
+
+// Shard holding the page of a file offset
+TIPPSE_INLINE struct file_cache_shard* file_cache_shard(struct file_cache* base, file_offset_t offset) {
+  return &base->shards[(offset/FILE_CACHE_PAGE_SIZE)%FILE_CACHE_SHARDS];
+}
+
+// Home slot of a page, the page number is scattered since neighbouring pages of a shard differ by the shard count only
+TIPPSE_INLINE size_t file_cache_slot(const struct file_cache_shard* shard, file_offset_t page) {
+  return (size_t)(((uint64_t)page*0x9e3779b97f4a7c15ull)>>32)&shard->slots_mask;
+}
 #endif  /* #ifndef TIPPSE_FILECACHE_H */
@@ -0,0 +1,92 @@
+// Tippse - File sink - Gather spans of fragments and cache pages and write them with few system calls
+
+#include "filesink.h"
+
+// Set up empty sink writing to file
+void file_sink_create_inplace(struct file_sink* base, struct file* file) {
+  base->file = file;
+  base->vectors = (struct file_vector*)malloc(sizeof(struct file_vector)*TIPPSE_FILE_VECTOR_MAX);
+  base->count = 0;
+  base->references = (struct file_sink_reference*)malloc(sizeof(struct file_sink_reference)*TIPPSE_FILE_VECTOR_MAX);
+  base->references_count = 0;
+  base->cached = 0;
+  base->written = 0;
+  base->failed = 0;
+}
+
+// Drop pending spans, call file_sink_flush before to write them
+void file_sink_destroy_inplace(struct file_sink* base) {
+  file_sink_release(base);
+  free(base->references);
+  free(base->vectors);
+}
+
+// Queue span, the page of a file cache is referenced until the span is written
+int file_sink_append(struct file_sink* base, const uint8_t* buffer, size_t length, struct file_cache* cache, struct file_cache_node* node) {
+  if (base->failed) {
+    return 0;
+  }
+
+  if (length==0) {
+    return 1;
+  }
+
+  if (cache) {
+    file_cache_clone(cache, node);
+    base->references[base->references_count].cache = cache;
+    base->references[base->references_count].node = node;
+    base->references_count++;
+    base->cached += length;
+  }
+
+  // Adjacent spans (e.g. consecutive slices of one fragment) are written as one
+  struct file_vector* last = (base->count>0)?&base->vectors[base->count-1]:NULL;
+  if (last && (const uint8_t*)last->buffer+last->length==buffer) {
+    last->length += length;
+  } else {
+    base->vectors[base->count].buffer = buffer;
+    base->vectors[base->count].length = length;
+    base->count++;
+  }
+
+  if (base->count==TIPPSE_FILE_VECTOR_MAX || base->references_count==TIPPSE_FILE_VECTOR_MAX || base->cached>=FILE_SINK_CACHED) {
+    return file_sink_flush(base);
+  }
+
+  return 1;
+}
+
+// Queue remaining span of the current stream page
+int file_sink_stream(struct file_sink* base, struct stream* stream) {
+  return file_sink_append(base, stream_buffer(stream), stream_cache_length(stream)-stream_displacement(stream), stream_page_cache(stream), stream->cache_node);
+}
+
+// Write all pending spans
+int file_sink_flush(struct file_sink* base) {
+  if (base->count>0 && !base->failed) {
+    size_t length = 0;
+    for (size_t n = 0; n<base->count; n++) {
+      length += base->vectors[n].length;
+    }
+
+    size_t written = file_write_vector(base->file, base->vectors, base->count);
+    base->written += written;
+    if (written!=length) {
+      base->failed = 1;
+    }
+  }
+
+  file_sink_release(base);
+  return !base->failed;
+}
+
+// Forget pending spans and release their cache pages
+void file_sink_release(struct file_sink* base) {
+  for (size_t n = 0; n<base->references_count; n++) {
+    file_cache_revoke(base->references[n].cache, base->references[n].node);
+  }
+
+  base->references_count = 0;
+  base->count = 0;
+  base->cached = 0;
+}
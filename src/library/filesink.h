@@ -0,0 +1,37 @@
+#ifndef TIPPSE_FILESINK_H
+#define TIPPSE_FILESINK_H
+
+#include <stdlib.h>
+#include "types.h"
+
+#include "file.h"
+#include "filecache.h"
+#include "stream.h"
+
+// Pending spans reference at most this amount of file cache pages before they are written
+#define FILE_SINK_CACHED FILE_CACHE_SIZE
+
+struct file_sink_reference {
+  struct file_cache* cache;             // cache owning the page
+  struct file_cache_node* node;         // page kept alive until written
+};
+
+struct file_sink {
+  struct file* file;                    // destination
+  struct file_vector* vectors;          // pending spans
+  size_t count;                         // number of pending spans
+  struct file_sink_reference* references; // cache pages of pending spans
+  size_t references_count;              // number of referenced cache pages
+  size_t cached;                        // bytes of pending spans located in cache pages
+  file_offset_t written;                // bytes written so far
+  int failed;                           // write failed?
+};
+
+void file_sink_create_inplace(struct file_sink* base, struct file* file);
+void file_sink_destroy_inplace(struct file_sink* base);
+int file_sink_append(struct file_sink* base, const uint8_t* buffer, size_t length, struct file_cache* cache, struct file_cache_node* node);
+int file_sink_stream(struct file_sink* base, struct stream* stream);
+int file_sink_flush(struct file_sink* base);
+void file_sink_release(struct file_sink* base);
+
+#endif /* #ifndef TIPPSE_FILESINK_H */
@@ -4,10 +4,43 @@
 
 #include "filecache.h"
 #include "atomic.h"
+#include "mutex.h"
+#include "pool.h"
+
+// Fragments are shared between trees and threads, so they are taken from a single locked pool
+static struct pool fragment_pool;
+static struct mutex fragment_pool_lock;
+
+// Initialize fragment pool
+void fragment_init(void) {
+  pool_create_inplace(&fragment_pool, sizeof(struct fragment), FRAGMENT_POOL_SLAB_MIN, FRAGMENT_POOL_SLAB_MAX);
+  mutex_create_inplace(&fragment_pool_lock);
+}
+
+// Free fragment pool
+void fragment_free(void) {
+  pool_destroy_inplace(&fragment_pool);
+  mutex_destroy_inplace(&fragment_pool_lock);
+}
+
+// Allocate fragment from pool
+TIPPSE_INLINE struct fragment* fragment_invoke(void) {
+  mutex_lock(&fragment_pool_lock);
+  struct fragment* base = (struct fragment*)pool_invoke(&fragment_pool);
+  mutex_unlock(&fragment_pool_lock);
+  return base;
+}
+
+// Return fragment to pool
+TIPPSE_INLINE void fragment_revoke(struct fragment* base) {
+  mutex_lock(&fragment_pool_lock);
+  pool_revoke(&fragment_pool, base);
+  mutex_unlock(&fragment_pool_lock);
+}
 
 // Return referenced fragment to a memory location
 struct fragment* fragment_create_memory(uint8_t* buffer, size_t length) {
-  struct fragment* base = (struct fragment*)malloc(sizeof(struct fragment));
+  struct fragment* base = fragment_invoke();
   base->type = FRAGMENT_MEMORY;
   base->count = 0;
   base->buffer = buffer;
@@ -17,9 +50,21 @@ struct fragment* fragment_create_memory(uint8_t* buffer, size_t length) {
   return base;
 }
 
+// Return referenced fragment to an empty memory block that is filled by appending only
+struct fragment* fragment_create_append(size_t length) {
+  struct fragment* base = fragment_create_memory((uint8_t*)malloc(length), length);
+  base->type = FRAGMENT_APPEND;
+  return base;
+}
+
+// Stop appending, from now on the fragment is handled like any other memory fragment
+void fragment_seal(struct fragment* base) {
+  base->type = FRAGMENT_MEMORY;
+}
+
 // Return referenced fragment to an on disk file location
 struct fragment* fragment_create_file(struct file_cache* cache, file_offset_t offset, file_offset_t length, struct range_tree_callback* callback) {
-  struct fragment* base = (struct fragment*)malloc(sizeof(struct fragment));
+  struct fragment* base = fragment_invoke();
   base->type = FRAGMENT_FILE;
   base->count = 0;
   base->cache = cache;
@@ -48,11 +93,11 @@ void fragment_dereference(struct fragment* base, struct range_tree_callback* cal
   }
 
   if (atomic_decrement_fileoffset_t(&base->count)==0) {
-    if (base->type==FRAGMENT_MEMORY) {
-      free(base->buffer);
-    } else {
+    if (base->type==FRAGMENT_FILE) {
       file_cache_dereference(base->cache);
+    } else {
+      free(base->buffer);
     }
-    free(base);
+    fragment_revoke(base);
   }
 }
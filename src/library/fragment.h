@@ -3,6 +3,11 @@
 
 #define FRAGMENT_MEMORY 0
 #define FRAGMENT_FILE 1
+#define FRAGMENT_APPEND 2
+
+// Fragment objects per slab in the fragment pool
+#define FRAGMENT_POOL_SLAB_MIN 64
+#define FRAGMENT_POOL_SLAB_MAX 4096
 
 #include <stdlib.h>
 #include "types.h"
@@ -18,7 +23,12 @@ struct fragment {
   file_offset_t length;                 // Length of fragment data
 };
 
+void fragment_init(void);
+void fragment_free(void);
+
 struct fragment* fragment_create_memory(uint8_t* buffer, size_t length);
+struct fragment* fragment_create_append(size_t length);
+void fragment_seal(struct fragment* base);
 struct fragment* fragment_create_file(struct file_cache* cache, file_offset_t offset, file_offset_t length, struct range_tree_callback* callback);
 void fragment_reference(struct fragment* base, struct range_tree_callback* callback);
 void fragment_dereference(struct fragment* base, struct range_tree_callback* callback);
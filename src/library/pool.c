@@ -0,0 +1,63 @@
+// Tippse - Pool - Slab allocator for many small objects of the same size
+
+#include "pool.h"
+
+// Set up empty pool, slabs grow from slab_min up to slab_max objects
+void pool_create_inplace(struct pool* base, size_t object_size, size_t slab_min, size_t slab_max) {
+  if (object_size<sizeof(struct pool_free)) {
+    object_size = sizeof(struct pool_free);
+  }
+
+  base->object_size = (object_size+sizeof(void*)-1)&~(sizeof(void*)-1);
+  base->slab_min = slab_min;
+  base->slab_max = slab_max;
+  base->slab_next = slab_min;
+  base->slabs = NULL;
+  base->free = NULL;
+  base->fill = NULL;
+  base->fill_end = NULL;
+  base->used = 0;
+}
+
+// Release all slabs
+void pool_destroy_inplace(struct pool* base) {
+  pool_empty(base);
+}
+
+// Release all slabs at once, every object of the pool becomes invalid
+void pool_empty(struct pool* base) {
+  while (base->slabs) {
+    struct pool_slab* next = base->slabs->next;
+    free(base->slabs);
+    base->slabs = next;
+  }
+
+  base->slab_next = base->slab_min;
+  base->free = NULL;
+  base->fill = NULL;
+  base->fill_end = NULL;
+  base->used = 0;
+}
+
+// Allocate next slab and return its first object
+void* pool_invoke_slab(struct pool* base) {
+  size_t header = (sizeof(struct pool_slab)+sizeof(void*)-1)&~(sizeof(void*)-1);
+  struct pool_slab* slab = (struct pool_slab*)malloc(header+base->object_size*base->slab_next);
+  slab->next = base->slabs;
+  slab->count = base->slab_next;
+  base->slabs = slab;
+
+  base->fill = ((uint8_t*)slab)+header;
+  base->fill_end = base->fill+base->object_size*slab->count;
+
+  if (base->slab_next<base->slab_max) {
+    base->slab_next *= 2;
+    if (base->slab_next>base->slab_max) {
+      base->slab_next = base->slab_max;
+    }
+  }
+
+  void* object = (void*)base->fill;
+  base->fill += base->object_size;
+  return object;
+}
@@ -0,0 +1,61 @@
+#ifndef TIPPSE_POOL_H
+#define TIPPSE_POOL_H
+
+#include <stdlib.h>
+#include "types.h"
+
+// Slab header, objects follow directly
+struct pool_slab {
+  struct pool_slab* next;       // Next slab in chain
+  size_t count;                 // Number of objects in slab
+};
+
+// Unused object in free list
+struct pool_free {
+  struct pool_free* next;       // Next unused object
+};
+
+struct pool {
+  size_t object_size;           // Size of a single object
+  size_t slab_min;              // Objects in first slab
+  size_t slab_max;              // Maximum objects per slab
+  size_t slab_next;             // Objects in next slab
+  struct pool_slab* slabs;      // Allocated slabs
+  struct pool_free* free;       // Returned objects ready for reuse
+  uint8_t* fill;                // Next untouched object in newest slab
+  uint8_t* fill_end;            // End of newest slab
+  size_t used;                  // Objects in use
+};
+
+void pool_create_inplace(struct pool* base, size_t object_size, size_t slab_min, size_t slab_max);
+void pool_destroy_inplace(struct pool* base);
+void pool_empty(struct pool* base);
+void* pool_invoke_slab(struct pool* base);
+
+// Allocate object
+TIPPSE_INLINE void* pool_invoke(struct pool* base) {
+  base->used++;
+  if (base->free) {
+    struct pool_free* object = base->free;
+    base->free = object->next;
+    return (void*)object;
+  }
+
+  if (LIKELY(base->fill<base->fill_end)) {
+    void* object = (void*)base->fill;
+    base->fill += base->object_size;
+    return object;
+  }
+
+  return pool_invoke_slab(base);
+}
+
+// Return object to free list, slabs are kept for reuse until the pool is emptied
+TIPPSE_INLINE void pool_revoke(struct pool* base, void* object) {
+  base->used--;
+  struct pool_free* unused = (struct pool_free*)object;
+  unused->next = base->free;
+  base->free = unused;
+}
+
+#endif /* #ifndef TIPPSE_POOL_H */
@@ -4,6 +4,7 @@
 
 #include "fragment.h"
 #include "stream.h"
+#include "atomic.h"
 
 int64_t range_tree_node_fuse_id = 1;
 
@@ -17,6 +18,9 @@ void range_tree_create_inplace(struct range_tree* base, struct range_tree_callba
   base->root = NULL;
   base->callback = callback;
   base->caps = caps;
+  base->finger = NULL;
+  base->finger_offset = 0;
+  base->pools = NULL;
 }
 
 void range_tree_destroy(struct range_tree* base) {
@@ -25,36 +29,60 @@ void range_tree_destroy(struct range_tree* base) {
 }
 
 void range_tree_destroy_inplace(struct range_tree* base) {
-  if (base->root) {
-    range_tree_node_destroy(base->root, base);
-    base->root = NULL;
-    base->callback = NULL;
+  range_tree_empty(base);
+  base->callback = NULL;
+  if (base->pools) {
+    pool_destroy_inplace(&base->pools->leaves);
+    pool_destroy_inplace(&base->pools->nodes);
+    free(base->pools);
+    base->pools = NULL;
   }
 }
 
-// Allocate range tree node
-struct range_tree_node* range_tree_invoke(struct range_tree* base) {
-  struct range_tree_node* node = (struct range_tree_node*)malloc(sizeof(struct range_tree_node));
-  return node;
+// Allocate range tree node, inner nodes carry no leaf fields
+struct range_tree_node* range_tree_invoke(struct range_tree* base, int leaf) {
+  if (!base->pools) {
+    int visual = (base->caps&TIPPSE_RANGETREE_CAPS_VISUAL)?1:0;
+    base->pools = (struct range_tree_pools*)malloc(sizeof(struct range_tree_pools));
+    pool_create_inplace(&base->pools->nodes, (visual?TREE_NODE_VISUAL_INNER:0)+TREE_NODE_SIZE_INNER, TREE_POOL_SLAB_MIN, TREE_POOL_SLAB_MAX);
+    pool_create_inplace(&base->pools->leaves, (visual?TREE_NODE_VISUAL_LEAF:0)+((base->caps&TIPPSE_RANGETREE_CAPS_SLIM)?TREE_NODE_SIZE_SLIM:TREE_NODE_SIZE_FULL), TREE_POOL_SLAB_MIN, TREE_POOL_SLAB_MAX);
+  }
+
+  uint8_t* object = (uint8_t*)pool_invoke(leaf?&base->pools->leaves:&base->pools->nodes);
+  if ((base->caps&TIPPSE_RANGETREE_CAPS_VISUAL)) {
+    object += leaf?TREE_NODE_VISUAL_LEAF:TREE_NODE_VISUAL_INNER;
+  }
+
+  return (struct range_tree_node*)object;
 }
 
-// Deallocate range tree node
+// Deallocate range tree node (inner nodes always have at least one child left, leaves never have one)
 void range_tree_revoke(struct range_tree* base, struct range_tree_node* node) {
   if (base->callback) {
     (*base->callback->node_destroy)(base->callback, node, base);
   }
 
-  if ((base->caps&TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA)) {
+  if (node==base->finger) {
+    base->finger = NULL;
+  }
+
+  int leaf = (!node->side[0] && !node->side[1])?1:0;
+  if (leaf && (base->caps&TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA)) {
     free(node->user_data);
     node->user_data = NULL;
   }
 
-  free(node);
+  uint8_t* object = (uint8_t*)node;
+  if ((base->caps&TIPPSE_RANGETREE_CAPS_VISUAL)) {
+    object -= leaf?TREE_NODE_VISUAL_LEAF:TREE_NODE_VISUAL_INNER;
+  }
+
+  pool_revoke(leaf?&base->pools->leaves:&base->pools->nodes, object);
 }
 
 // Reallocate the fragment if it is referenced only once and had become smaller due to the edit process (save memory)
 void range_tree_node_invalidate(struct range_tree_node* node, struct range_tree* base) {
-  if (node->buffer) {
+  if (!(base->caps&TIPPSE_RANGETREE_CAPS_SLIM) && node->buffer) {
     if (base->callback) {
       (*base->callback->node_invalidate)(base->callback, node, base);
     }
@@ -87,7 +115,7 @@ void range_tree_node_cache_invalidate(struct range_tree_node* node, struct range
     return;
   }
 
-  if (node->buffer && node->buffer->type==FRAGMENT_FILE) {
+  if ((node->inserter&TIPPSE_INSERTER_LEAF) && node->buffer && node->buffer->type==FRAGMENT_FILE) {
     if (!cache || node->buffer->cache==cache) {
       struct stream stream;
       stream_from_page(&stream, node, 0);
@@ -107,6 +135,79 @@ void range_tree_node_cache_invalidate(struct range_tree_node* node, struct range
   range_tree_node_cache_invalidate(node->side[1], base, cache);
 }
 
+// Point all leaves to consecutive ranges of a fragment with identical content, nodes and their cached visuals and summaries stay valid
+void range_tree_rebind(struct range_tree* base, struct fragment* buffer) {
+  file_offset_t offset = 0;
+  range_tree_node_rebind(base->root, base, buffer, &offset);
+}
+
+// Check if both trees refer to the same ranges of the same fragments, the leaves may be split differently
+int range_tree_same(struct range_tree* base, struct range_tree* other) {
+  if (range_tree_length(base)!=range_tree_length(other)) {
+    return 0;
+  }
+
+  struct range_tree_node* left = range_tree_first(base);
+  struct range_tree_node* right = range_tree_first(other);
+  file_offset_t left_split = 0;
+  file_offset_t right_split = 0;
+  while (left && right) {
+    if (left->buffer!=right->buffer || left->offset+left_split!=right->offset+right_split) {
+      return 0;
+    }
+
+    file_offset_t length = left->length-left_split;
+    if (length>right->length-right_split) {
+      length = right->length-right_split;
+    }
+
+    left_split += length;
+    if (left_split==left->length) {
+      left = left->next;
+      left_split = 0;
+    }
+
+    right_split += length;
+    if (right_split==right->length) {
+      right = right->next;
+      right_split = 0;
+    }
+  }
+
+  return (!left && !right)?1:0;
+}
+
+// Rebind leaves of the node recursively, offset follows the leaves in order
+void range_tree_node_rebind(struct range_tree_node* node, struct range_tree* base, struct fragment* buffer, file_offset_t* offset) {
+  if (!node) {
+    return;
+  }
+
+  node->inserter &= ~TIPPSE_INSERTER_FILE;
+  if (buffer->type==FRAGMENT_FILE) {
+    node->inserter |= TIPPSE_INSERTER_FILE;
+  }
+
+  if (node->inserter&TIPPSE_INSERTER_LEAF) {
+    fragment_reference(buffer, base->callback);
+    if (node->buffer) {
+      fragment_dereference(node->buffer, base->callback);
+    }
+
+    if ((base->caps&TIPPSE_RANGETREE_CAPS_VISUAL) && range_tree_node_summarized(node)) {
+      range_tree_node_visual(node)->summary_offset = *offset;
+    }
+
+    node->buffer = buffer;
+    node->offset = *offset;
+    *offset += node->length;
+    return;
+  }
+
+  range_tree_node_rebind(node->side[0], base, buffer, offset);
+  range_tree_node_rebind(node->side[1], base, buffer, offset);
+}
+
 // Try to merge range of nodes which are below the maximum page size
 void range_tree_fuse(struct range_tree* base, struct range_tree_node* first, struct range_tree_node* last) {
   if (!first) {
@@ -121,11 +222,25 @@ void range_tree_fuse(struct range_tree* base, struct range_tree_node* first, str
     struct range_tree_node* next = range_tree_node_next(first);
 
     if (first->inserter==next->inserter && (!(first->inserter&TIPPSE_INSERTER_NOFUSE) || first->fuse_id==next->fuse_id)) {
-      if (!first->buffer && !next->buffer) {
+      if ((base->caps&TIPPSE_RANGETREE_CAPS_SLIM) || (!first->buffer && !next->buffer)) {
+        if (next==base->finger) {
+          base->finger = NULL;
+        }
+
         next->length = first->length+next->length;
         range_tree_node_update(next, base);
         first->inserter &= ~TIPPSE_INSERTER_LEAF;
         range_tree_node_update(first, base);
+      } else if (first->length+next->length<=TREE_BLOCK_LENGTH_MIN && range_tree_node_consecutive(first, next)) {
+        // Neighbors are consecutive slices of the same fragment or file, join them without copying up to a render page, larger runs are left to document_file_coarsen
+        if (next==last) {
+          last = first;
+        }
+
+        range_tree_join(base, first);
+        range_tree_node_invalidate(first, base);
+        range_tree_node_update(first, base);
+        continue;
       } else if (first->length+next->length<TREE_BLOCK_LENGTH_MIN) {
         if (first->buffer && next->buffer && (first->buffer->type==FRAGMENT_MEMORY && next->buffer->type==FRAGMENT_MEMORY)) {
 
@@ -170,6 +285,42 @@ void range_tree_fuse(struct range_tree* base, struct range_tree_node* first, str
   }
 }
 
+// Check if both neighbors reference consecutive content of the same fragment or the same file cache
+int range_tree_node_consecutive(const struct range_tree_node* first, const struct range_tree_node* next) {
+  if (!first->buffer || !next->buffer) {
+    return 0;
+  }
+
+  if (first->buffer==next->buffer) {
+    return (first->offset+first->length==next->offset)?1:0;
+  }
+
+  if (first->buffer->type!=FRAGMENT_FILE || next->buffer->type!=FRAGMENT_FILE || first->buffer->cache!=next->buffer->cache) {
+    return 0;
+  }
+
+  return (first->buffer->offset+first->offset+first->length==next->buffer->offset+next->offset)?1:0;
+}
+
+// Join the following consecutive neighbor into node, visual information is left to the caller
+void range_tree_join(struct range_tree* base, struct range_tree_node* node) {
+  struct range_tree_node* next = node->next;
+  if (node->buffer!=next->buffer) {
+    struct fragment* buffer = fragment_create_file(node->buffer->cache, node->buffer->offset+node->offset, node->length+next->length, base->callback);
+    fragment_dereference(node->buffer, base->callback);
+    node->buffer = buffer;
+    node->offset = 0;
+  }
+
+  node->length += next->length;
+  range_tree_node_update(node, base);
+
+  fragment_dereference(next->buffer, base->callback);
+  next->buffer = NULL;
+  next->inserter &= ~TIPPSE_INSERTER_LEAF;
+  range_tree_node_update(next, base);
+}
+
 // Insert fragment into specific offset and eventually break older nodes into parts
 void range_tree_insert(struct range_tree* base, file_offset_t offset, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter, int64_t fuse_id, void* user_data) {
   struct range_tree_node* build1 = range_tree_node_create(NULL, base, NULL, NULL, buffer, buffer_offset, buffer_length, inserter|TIPPSE_INSERTER_LEAF, fuse_id, user_data);
@@ -182,7 +333,7 @@ void range_tree_insert(struct range_tree* base, file_offset_t offset, struct fra
   }
 
   file_offset_t split;
-  struct range_tree_node* node = range_tree_node_find_offset(base->root, offset, &split);
+  struct range_tree_node* node = range_tree_find_offset(base, offset, &split);
   if (split>node->length) {
     fprintf(stderr, "Tried to append a new node past the end... Please file a bug report!");
     abort();
@@ -223,6 +374,11 @@ void range_tree_insert(struct range_tree* base, file_offset_t offset, struct fra
   range_tree_node_invalidate(build1, base);
   range_tree_node_invalidate(node, base);
   range_tree_node_update(build0, base);
+
+  if (base->finger && base->finger_offset>=offset) {
+    base->finger_offset += buffer_length;
+  }
+
   range_tree_fuse(base, range_tree_node_prev(build1), range_tree_node_next(node));
 }
 
@@ -237,19 +393,47 @@ void range_tree_insert_split(struct range_tree* base, file_offset_t offset, cons
     uint8_t* copy = (uint8_t*)malloc(size);
     memcpy(copy, text+pos, size);
     struct fragment* buffer = fragment_create_memory(copy, size);
-    range_tree_node_fuse_id++;
-    range_tree_insert(base, offset, buffer, 0, buffer->length, inserter, range_tree_node_fuse_id, NULL);
+    range_tree_insert(base, offset, buffer, 0, buffer->length, inserter, atomic_increment_int64_t(&range_tree_node_fuse_id), NULL);
     fragment_dereference(buffer, NULL);
 
     offset += TREE_BLOCK_LENGTH_MID;
   }
 }
 
+// Insert fragment range, the node ending at offset is stretched instead if it already ends at the same fragment position
+void range_tree_insert_extend(struct range_tree* base, file_offset_t offset, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter) {
+  file_offset_t split = 0;
+  struct range_tree_node* node = range_tree_find_offset(base, offset, &split);
+  if (node && split==0) {
+    node = range_tree_node_prev(node);
+  } else if (node && split!=node->length) {
+    node = NULL;
+  }
+
+  if (node && node->buffer==buffer && node->offset+node->length==buffer_offset && node->inserter==(inserter|TIPPSE_INSERTER_LEAF) && !(inserter&TIPPSE_INSERTER_NOFUSE) && node->length+buffer_length<=TREE_BLOCK_LENGTH_MID) {
+    node->length += buffer_length;
+    range_tree_node_invalidate(node, base);
+    range_tree_node_update(node, base);
+
+    if (base->finger && base->finger_offset>=offset) {
+      base->finger_offset += buffer_length;
+    }
+
+    struct range_tree_node* next = range_tree_node_next(node);
+    if (next) {
+      range_tree_node_invalidate(next, base);
+    }
+    return;
+  }
+
+  range_tree_insert(base, offset, buffer, buffer_offset, buffer_length, inserter, atomic_increment_int64_t(&range_tree_node_fuse_id), NULL);
+}
+
 // Remove specific range from base (eventually break nodes into parts)
 void range_tree_delete(struct range_tree* base, file_offset_t offset, file_offset_t length, int inserter) {
   while (length>0) {
     file_offset_t split = 0;
-    struct range_tree_node* node = range_tree_node_find_offset(base->root, offset, &split);
+    struct range_tree_node* node = range_tree_find_offset(base, offset, &split);
     if (!node) {
       return;
     }
@@ -264,8 +448,11 @@ void range_tree_delete(struct range_tree* base, file_offset_t offset, file_offse
     struct range_tree_node* after = range_tree_node_next(node);
 
     length -= node->length;
+    if (base->finger && base->finger_offset>offset) {
+      base->finger_offset -= node->length;
+    }
 
-    if (node->buffer) {
+    if (!(base->caps&TIPPSE_RANGETREE_CAPS_SLIM) && node->buffer) {
       fragment_dereference(node->buffer, base->callback);
       node->buffer = NULL;
     }
@@ -292,23 +479,163 @@ void range_tree_delete(struct range_tree* base, file_offset_t offset, file_offse
   }
 }
 
-// Create copy of a specific range
+// Remove a specific range and hand its fragments over to a new tree instead of copying and releasing them
+struct range_tree* range_tree_cut(struct range_tree* base, file_offset_t offset, file_offset_t length) {
+  struct range_tree* cut = range_tree_create(base->callback, base->caps&(TIPPSE_RANGETREE_CAPS_SLIM|TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA));
+  file_offset_t split = 0;
+  struct range_tree_node* node = range_tree_find_offset(base, offset, &split);
+  if (!node || length==0) {
+    return cut;
+  }
+
+  range_tree_split(base, &node, split, 1);
+  struct range_tree_node* before = range_tree_node_prev(node);
+  struct range_tree_node* after = node;
+  struct range_tree_build build;
+  range_tree_build_begin(&build, cut);
+  while (node && length>0) {
+    if (node->length>length) {
+      struct range_tree_node* next = node;
+      range_tree_split(base, &next, length, 1);
+    }
+
+    after = range_tree_node_next(node);
+    length -= node->length;
+    if (base->finger && base->finger_offset>offset) {
+      base->finger_offset -= node->length;
+    }
+
+    range_tree_build_take(&build, node);
+    node->inserter &= ~TIPPSE_INSERTER_LEAF;
+    range_tree_node_update(node, base);
+    node = after;
+  }
+
+  range_tree_build_end(&build);
+
+  if (before) {
+    range_tree_node_invalidate(before, base);
+    range_tree_node_update(before, base);
+  }
+
+  if (after) {
+    range_tree_node_invalidate(after, base);
+    range_tree_node_update(after, base);
+  }
+
+  if (base->root) {
+    range_tree_fuse(base, before, after);
+  }
+
+  return cut;
+}
+
+// Create copy of a specific range, the copy shares all fragments with base
 struct range_tree* range_tree_copy(struct range_tree* base, file_offset_t offset, file_offset_t length, struct range_tree_callback* callback) {
-  struct range_tree* copy = range_tree_create(callback, 0);
-  range_tree_node_copy_insert(base->root, offset, copy, 0, length);
+  struct range_tree* copy = range_tree_create(callback, base->caps&TIPPSE_RANGETREE_CAPS_SLIM);
+  struct range_tree_build build;
+  range_tree_build_begin(&build, copy);
+  range_tree_build_copy(&build, base->root, offset, length);
+  range_tree_build_end(&build);
   return copy;
 }
 
 // Insert already built nodes
 void range_tree_paste(struct range_tree* base, struct range_tree_node* copy, file_offset_t offset) {
+  int slim = (base->caps&TIPPSE_RANGETREE_CAPS_SLIM)?1:0;
   copy = range_tree_node_first(copy);
   while (copy) {
-    range_tree_insert(base, offset, copy->buffer, copy->offset, copy->length, copy->inserter, copy->fuse_id, copy->user_data);
+    range_tree_insert(base, offset, slim?NULL:copy->buffer, slim?0:copy->offset, copy->length, copy->inserter, copy->fuse_id, copy->user_data);
     offset += copy->length;
     copy = range_tree_node_next(copy);
   }
 }
 
+// Start to build an empty tree from scratch
+void range_tree_build_begin(struct range_tree_build* base, struct range_tree* tree) {
+  base->tree = tree;
+  base->first = NULL;
+  base->last = NULL;
+  base->count = 0;
+}
+
+// Append leaf to the end of the chain, no fuse or balance is done until the end
+void range_tree_build_append(struct range_tree_build* base, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter, int64_t fuse_id, void* user_data) {
+  if (buffer_length==0) {
+    return;
+  }
+
+  struct range_tree_node* node = range_tree_node_create(NULL, base->tree, NULL, NULL, buffer, buffer_offset, buffer_length, inserter|TIPPSE_INSERTER_LEAF, fuse_id, user_data);
+  node->depth = 1;
+  node->prev = base->last;
+  if (base->last) {
+    base->last->next = node;
+  } else {
+    base->first = node;
+  }
+
+  base->last = node;
+  base->count++;
+}
+
+// Append leaf that takes over fragment and user data of a leaf leaving another tree with the same callback
+void range_tree_build_take(struct range_tree_build* base, struct range_tree_node* node) {
+  range_tree_build_append(base, NULL, 0, node->length, node->inserter&~TIPPSE_INSERTER_LEAF, node->fuse_id, node->user_data);
+  if (!(base->tree->caps&TIPPSE_RANGETREE_CAPS_SLIM)) {
+    base->last->buffer = node->buffer;
+    base->last->offset = node->offset;
+    node->buffer = NULL;
+  }
+
+  node->user_data = NULL;
+}
+
+// Append leaves of a specific range from another tree with the same layout
+void range_tree_build_copy(struct range_tree_build* base, struct range_tree_node* root_from, file_offset_t offset_from, file_offset_t length) {
+  int slim = (base->tree->caps&TIPPSE_RANGETREE_CAPS_SLIM)?1:0;
+  file_offset_t split = 0;
+  struct range_tree_node* node = range_tree_node_find_offset(root_from, offset_from, &split);
+  while (node && length>0) {
+    file_offset_t split2 = node->length-split;
+    if (split2>length) {
+      split2 = length;
+    }
+
+    range_tree_build_append(base, slim?NULL:node->buffer, slim?0:node->offset+split, split2, node->inserter&~(TIPPSE_INSERTER_LEAF|TIPPSE_INSERTER_FILE), node->fuse_id, node->user_data);
+    length -= split2;
+    split = 0;
+    node = range_tree_node_next(node);
+  }
+}
+
+// Link the chain into a balanced tree in linear time
+void range_tree_build_end(struct range_tree_build* base) {
+  struct range_tree_node* leaf = base->first;
+  base->tree->root = base->count?range_tree_build_node(base->tree, &leaf, base->count):NULL;
+  base->tree->finger = NULL;
+  base->first = NULL;
+  base->last = NULL;
+  base->count = 0;
+}
+
+// Build subtree from the next count leaves of the chain, the left side gets the bigger half to keep the balance rule
+struct range_tree_node* range_tree_build_node(struct range_tree* tree, struct range_tree_node** leaf, size_t count) {
+  if (count==1) {
+    struct range_tree_node* node = *leaf;
+    *leaf = node->next;
+    return node;
+  }
+
+  size_t left = (count+1)/2;
+  struct range_tree_node* side0 = range_tree_build_node(tree, leaf, left);
+  struct range_tree_node* side1 = range_tree_build_node(tree, leaf, count-left);
+  struct range_tree_node* node = range_tree_node_create(NULL, tree, side0, side1, NULL, 0, 0, 0, 0, NULL);
+  side0->parent = node;
+  side1->parent = node;
+  range_tree_node_update_calc(node, tree);
+  return node;
+}
+
 // Copy specific range from base into a buffer
 uint8_t* range_tree_raw(struct range_tree* base, file_offset_t start, file_offset_t end) {
   if (!base->root || end<=start) {
@@ -320,7 +647,7 @@ uint8_t* range_tree_raw(struct range_tree* base, file_offset_t start, file_offse
   uint8_t* out = text;
 
   file_offset_t split = 0;
-  struct range_tree_node* node = range_tree_node_find_offset(base->root, start, &split);
+  struct range_tree_node* node = range_tree_find_offset(base, start, &split);
 
   struct stream stream;
   stream_from_page(&stream, node, split);
@@ -342,12 +669,18 @@ uint8_t* range_tree_raw(struct range_tree* base, file_offset_t start, file_offse
   return text;
 }
 
-// Cleanup base
+// Cleanup base, node memory is given back to the pool at once
 void range_tree_empty(struct range_tree* base) {
   if (base->root) {
-    range_tree_node_destroy(base->root, base);
+    range_tree_node_release(base->root, base);
     base->root = NULL;
   }
+
+  base->finger = NULL;
+  if (base->pools) {
+    pool_empty(&base->pools->leaves);
+    pool_empty(&base->pools->nodes);
+  }
 }
 
 // Cleanup base and build single full length node
@@ -378,10 +711,13 @@ void range_tree_resize(struct range_tree* base, file_offset_t length, int insert
 // Stretch node at offset by given length
 void range_tree_expand(struct range_tree* base, file_offset_t offset, file_offset_t length) {
   file_offset_t split = 0;
-  struct range_tree_node* node = range_tree_node_find_offset(base->root, offset, &split);
+  struct range_tree_node* node = range_tree_find_offset(base, offset, &split);
   if (node) {
     node->length += length;
     range_tree_node_update(node, base);
+    if (base->finger && base->finger_offset>offset-split) {
+      base->finger_offset += length;
+    }
   } else {
     range_tree_resize(base, length, 0);
   }
@@ -395,7 +731,8 @@ void range_tree_reduce(struct range_tree* base, file_offset_t offset, file_offse
 // Split node into upper and lower parts
 void range_tree_split(struct range_tree* base, struct range_tree_node** node, file_offset_t split, int invalidate) {
   if (*node && split>0 && split<(*node)->length) {
-    struct range_tree_node* build1 = range_tree_node_create(NULL, base, NULL, NULL, (*node)->buffer, (*node)->offset+split, (*node)->length-split, (*node)->inserter, (*node)->fuse_id, (*node)->user_data);
+    int slim = (base->caps&TIPPSE_RANGETREE_CAPS_SLIM)?1:0;
+    struct range_tree_node* build1 = range_tree_node_create(NULL, base, NULL, NULL, slim?NULL:(*node)->buffer, slim?0:(*node)->offset+split, (*node)->length-split, (*node)->inserter, (*node)->fuse_id, (*node)->user_data);
     struct range_tree_node* build0 = range_tree_node_create((*node)->parent, base, *node, build1, NULL, 0, 0, 0, 0, NULL);
     (*node)->length = split;
 
@@ -429,7 +766,7 @@ void range_tree_mark(struct range_tree* base, file_offset_t offset, file_offset_
 
   file_offset_t split = 0;
 
-  struct range_tree_node* first = range_tree_node_find_offset(base->root, offset, &split);
+  struct range_tree_node* first = range_tree_find_offset(base, offset, &split);
   struct range_tree_node* before = range_tree_node_prev(first);
   if (!before) {
     before = first;
@@ -438,17 +775,17 @@ void range_tree_mark(struct range_tree* base, file_offset_t offset, file_offset_
   range_tree_split(base, &first, split, 0);
 
   struct range_tree_node* after = NULL;
-  struct range_tree_node* last = range_tree_node_find_offset(base->root, offset+length, &split);
+  struct range_tree_node* last = range_tree_find_offset(base, offset+length, &split);
   if (offset+length<range_tree_length(base)) {
     after = last;
     range_tree_split(base, &after, split, 0);
   }
 
-  range_tree_node_fuse_id++;
+  int64_t fuse_id = atomic_increment_int64_t(&range_tree_node_fuse_id);
 
   while (1) {
     first->inserter = inserter|TIPPSE_INSERTER_LEAF;
-    first->fuse_id = range_tree_node_fuse_id;
+    first->fuse_id = fuse_id;
     range_tree_node_update(first, base);
     if (first==after) {
       break;
@@ -467,7 +804,7 @@ void range_tree_mark(struct range_tree* base, file_offset_t offset, file_offset_
 struct range_tree_node* range_tree_marked_next(struct range_tree* base, file_offset_t offset, file_offset_t* low, file_offset_t* high, int skip_first) {
   if (base->root && offset<range_tree_length(base)) {
     file_offset_t displacement;
-    struct range_tree_node* node = range_tree_node_find_offset(base->root, offset, &displacement);
+    struct range_tree_node* node = range_tree_find_offset(base, offset, &displacement);
     offset -= displacement;
     while (node) {
       if (node->inserter&TIPPSE_INSERTER_MARK && !skip_first) {
@@ -490,7 +827,7 @@ struct range_tree_node* range_tree_marked_next(struct range_tree* base, file_off
 struct range_tree_node* range_tree_marked_prev(struct range_tree* base, file_offset_t offset, file_offset_t* low, file_offset_t* high, int skip_first) {
   if (base->root && (offset>0 || !skip_first)) {
     file_offset_t displacement;
-    struct range_tree_node* node = range_tree_node_find_offset(base->root, offset, &displacement);
+    struct range_tree_node* node = range_tree_find_offset(base, offset, &displacement);
     offset -= displacement;
     while (node) {
       if (node->inserter&TIPPSE_INSERTER_MARK && !skip_first) {
@@ -512,7 +849,7 @@ struct range_tree_node* range_tree_marked_prev(struct range_tree* base, file_off
 }
 
 
-// Debug: Recursively print tree nodes
+// Debug: Recursively print tree nodes (fragment holding trees only)
 void range_tree_node_print(const struct range_tree_node* node, int depth, int side) {
   int tab = depth;
   while (tab>0) {
@@ -520,7 +857,8 @@ void range_tree_node_print(const struct range_tree_node* node, int depth, int si
     tab--;
   }
 
-  fprintf(stderr, "%d %5d %s(%p-%p) %5d %5d (%p) (%x)", side, (int)node->length, node->buffer?"B":" ", (void*)node->buffer, (void*)(node->buffer?node->buffer->buffer:NULL), (int)node->offset, node->depth, (void*)node, node->inserter);
+  const struct fragment* buffer = (node->inserter&TIPPSE_INSERTER_LEAF)?node->buffer:NULL;
+  fprintf(stderr, "%d %5d %s(%p-%p) %5d %5d (%p) (%x)", side, (int)node->length, buffer?"B":" ", (void*)buffer, (void*)(buffer?buffer->buffer:NULL), buffer?(int)node->offset:0, node->depth, (void*)node, node->inserter);
   fprintf(stderr, "\r\n");
   if (node->side[0]) {
     range_tree_node_print(node->side[0], depth+1, 0);
@@ -531,7 +869,7 @@ void range_tree_node_print(const struct range_tree_node* node, int depth, int si
   }
 }
 
-// Debug: Check tree for consistency (TODO: Next/Prev fields are not covered)
+// Debug: Check tree for consistency, fragment holding trees only (TODO: Next/Prev fields are not covered)
 void range_tree_node_check(const struct range_tree_node* node) {
   if (!node) {
     return;
@@ -549,7 +887,7 @@ void range_tree_node_check(const struct range_tree_node* node) {
     printf("unbalanced node %p: %p %p\r\n", (void*)node, (void*)node->side[0], (void*)node->side[1]);
   }
 
-  if (node->buffer && (node->side[0] || node->side[1])) {
+  if ((node->inserter&TIPPSE_INSERTER_LEAF) && (node->side[0] || node->side[1])) {
     printf("Leaf with children %p: %p %p\r\n", (void*)node, (void*)node->side[0], (void*)node->side[1]);
   }
 
@@ -561,6 +899,10 @@ void range_tree_node_check(const struct range_tree_node* node) {
     range_tree_node_check(node->side[1]);
   }
 
+  if (!(node->inserter&TIPPSE_INSERTER_LEAF) || !node->buffer) {
+    return;
+  }
+
   if (node->buffer->type==FRAGMENT_FILE) {
     if (!(node->inserter&TIPPSE_INSERTER_FILE)) {
       printf("fragment from file not marked\r\n");
@@ -623,37 +965,87 @@ void range_tree_node_destroy(struct range_tree_node* node, struct range_tree* tr
   range_tree_node_destroy(node->side[0], tree);
   range_tree_node_destroy(node->side[1], tree);
 
-  if (node->buffer) {
+  if ((node->inserter&TIPPSE_INSERTER_LEAF) && !(tree->caps&TIPPSE_RANGETREE_CAPS_SLIM) && node->buffer) {
     fragment_dereference(node->buffer, tree->callback);
   }
 
   range_tree_revoke(tree, node);
 }
 
+// Remove node and all children without returning them to the pool (the caller empties the pool afterwards)
+void range_tree_node_release(struct range_tree_node* node, struct range_tree* tree) {
+  int slim = (tree->caps&TIPPSE_RANGETREE_CAPS_SLIM)?1:0;
+  if (tree->callback) {
+    if (node->side[0]) {
+      range_tree_node_release(node->side[0], tree);
+      range_tree_node_release(node->side[1], tree);
+    }
+
+    (*tree->callback->node_destroy)(tree->callback, node, tree);
+    if (node->side[0]) {
+      return;
+    }
+  } else {
+    // Without callback the internal nodes carry nothing to release, just walk the leaves
+    node = range_tree_node_first(node);
+    while (node) {
+      if (!slim && node->buffer) {
+        fragment_dereference(node->buffer, NULL);
+      }
+
+      if ((tree->caps&TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA)) {
+        free(node->user_data);
+      }
+
+      node = node->next;
+    }
+
+    return;
+  }
+
+  if (!slim && node->buffer) {
+    fragment_dereference(node->buffer, tree->callback);
+  }
+
+  if ((tree->caps&TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA)) {
+    free(node->user_data);
+  }
+}
+
 // Create node with given fragment
 struct range_tree_node* range_tree_node_create(struct range_tree_node* parent, struct range_tree* tree, struct range_tree_node* side0, struct range_tree_node* side1, struct fragment* buffer, file_offset_t offset, file_offset_t length, int inserter, int64_t fuse_id, void* user_data) {
-  struct range_tree_node* node = range_tree_invoke(tree);
+  int leaf = (inserter&TIPPSE_INSERTER_LEAF)?1:0;
+  struct range_tree_node* node = range_tree_invoke(tree, leaf);
   node->parent = parent;
   node->side[0] = side0;
   node->side[1] = side1;
-  node->buffer = buffer;
-  node->next = NULL;
-  node->prev = NULL;
-  if (node->buffer) {
-    fragment_reference(node->buffer, tree->callback);
-    if (node->buffer->type==FRAGMENT_FILE) {
-      inserter |= TIPPSE_INSERTER_FILE;
+  if (leaf) {
+    node->next = NULL;
+    node->prev = NULL;
+    node->fuse_id = fuse_id;
+    node->user_data = user_data;
+    if (!(tree->caps&TIPPSE_RANGETREE_CAPS_SLIM)) {
+      node->buffer = buffer;
+      node->offset = offset;
+      if (node->buffer) {
+        fragment_reference(node->buffer, tree->callback);
+        if (node->buffer->type==FRAGMENT_FILE) {
+          inserter |= TIPPSE_INSERTER_FILE;
+        }
+      }
     }
   }
 
-  node->offset = offset;
   node->length = length;
   node->inserter = inserter;
   node->depth = 0;
-  node->fuse_id = fuse_id;
-  node->user_data = user_data;
-  node->visuals = NULL;
-  node->view_uid = 0;
+  if ((tree->caps&TIPPSE_RANGETREE_CAPS_VISUAL)) {
+    struct range_tree_node_visual* visual = range_tree_node_visual(node);
+    visual->visuals = NULL;
+    visual->view_uid = 0;
+    visual->summarized = 0;
+  }
+
   return node;
 }
 
@@ -811,10 +1203,37 @@ struct range_tree_node* range_tree_node_find_offset(struct range_tree_node* node
   return node;
 }
 
-// Create copy of a specific range and insert into another or same tree
+// Search leaf by offset starting at the last found leaf, climb up until the subtree covers the offset and descend from there
+struct range_tree_node* range_tree_find_offset(struct range_tree* base, file_offset_t offset, file_offset_t* diff) {
+  struct range_tree_node* node = base->finger;
+  file_offset_t start = base->finger_offset;
+  if (!node) {
+    node = base->root;
+    start = 0;
+  }
+
+  while (node && node->parent && (offset<start || offset-start>=node->length)) {
+    if (node->parent->side[1]==node) {
+      start -= node->parent->side[0]->length;
+    }
+
+    node = node->parent;
+  }
+
+  node = range_tree_node_find_offset(node, offset-start, diff);
+  if (node) {
+    base->finger = node;
+    base->finger_offset = offset-*diff;
+  }
+
+  return node;
+}
+
+// Create copy of a specific range and insert into another or same tree (both trees must either hold fragments or be slim)
 void range_tree_node_copy_insert(struct range_tree_node* root_from, file_offset_t offset_from, struct range_tree* tree_to, file_offset_t offset_to, file_offset_t length) {
   file_offset_t split = 0;
   int same = (root_from==tree_to->root)?1:0;
+  int slim = (tree_to->caps&TIPPSE_RANGETREE_CAPS_SLIM)?1:0;
   struct range_tree_node* node = range_tree_node_find_offset(root_from, offset_from, &split);
   while (node && length>0) {
     file_offset_t split2 = node->length-split;
@@ -822,7 +1241,7 @@ void range_tree_node_copy_insert(struct range_tree_node* root_from, file_offset_
       split2 = length;
     }
 
-    range_tree_insert(tree_to, offset_to, node->buffer, node->offset+split, split2, node->inserter, node->fuse_id, node->user_data);
+    range_tree_insert(tree_to, offset_to, slim?NULL:node->buffer, slim?0:node->offset+split, split2, node->inserter, node->fuse_id, node->user_data);
     offset_to += split2;
     offset_from += split2;
     length -= split2;
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "types.h"
 
@@ -24,9 +25,16 @@
 #define TIPPSE_INSERTER_HIGHLIGHT_COLOR_SHIFT 16
 
 #define TIPPSE_RANGETREE_CAPS_DEALLOCATE_USER_DATA 1
-#define TIPPSE_RANGETREE_CAPS_USER 2
+#define TIPPSE_RANGETREE_CAPS_VISUAL 2
+#define TIPPSE_RANGETREE_CAPS_SLIM 4
+#define TIPPSE_RANGETREE_CAPS_USER 8
 
 #include "list.h"
+#include "pool.h"
+
+// Node objects per slab in the tree node pool, the first slab holds a single node so that small trees cost no more than plain allocations
+#define TREE_POOL_SLAB_MIN 1
+#define TREE_POOL_SLAB_MAX 4096
 
 struct fragment;
 struct range_tree_node;
@@ -40,28 +48,66 @@ struct range_tree_callback {
   void (*node_destroy)(struct range_tree_callback* base, struct range_tree_node* node, struct range_tree* tree);
 };
 
+// Nodes are allocated only as large as needed, fields below are present ...
+// ... in every node (inner node)
+//     "next" and following in leaves (slim leaf, trees with TIPPSE_RANGETREE_CAPS_SLIM never hold fragments)
+//     "buffer" and following in leaves of all other trees (full leaf)
+// Trees with TIPPSE_RANGETREE_CAPS_VISUAL keep a struct range_tree_node_visual directly in front of every node, inner nodes only from "visuals" on
 struct range_tree_node {
   struct range_tree_node* parent;   // parent node
   struct range_tree_node* side[2];  // binary split (left and right side)
-  struct range_tree_node* next;     // Next element in overlay list for the leaf nodes
-  struct range_tree_node* prev;     // Previous element in overlay list for the leaf nodes
   file_offset_t length;             // Length of node
   int depth;                        // Current depth level
   int inserter;                     // Combined flags to modify interaction rules
 
-  // TODO: shrink structure dynamically depending on type of tree
+  struct range_tree_node* next;     // Next element in overlay list for the leaf nodes
+  struct range_tree_node* prev;     // Previous element in overlay list for the leaf nodes
   int64_t fuse_id;                  // Only fuse neighbor nodes with the same fuse identification
+  void* user_data;                  // User defined data
+
   struct fragment* buffer;          // Buffer to file content
   file_offset_t offset;             // Relative start offset to the beginning of the file content buffer
-  void* user_data;                  // User defined data
+};
+
+#define TREE_NODE_SIZE_INNER offsetof(struct range_tree_node, next)
+#define TREE_NODE_SIZE_SLIM offsetof(struct range_tree_node, buffer)
+#define TREE_NODE_SIZE_FULL sizeof(struct range_tree_node)
+
+struct range_tree_node_visual {
+  file_offset_t summary_offset;     // Leaf offset the summary was built for (leaf only)
+
   struct visual_info* visuals;      // Cached visual information by view_uid
   int view_uid;                     // Unique view identifier for caching
+  int summarized;                   // View independent summary below is known
+  file_offset_t lines;              // Number of newlines in node
+  file_offset_t characters;         // Number of characters starting in node
+  file_offset_t summary_length;     // Node length the summary was built for
+};
+
+#define TREE_NODE_VISUAL_INNER (sizeof(struct range_tree_node_visual)-offsetof(struct range_tree_node_visual, visuals))
+#define TREE_NODE_VISUAL_LEAF sizeof(struct range_tree_node_visual)
+
+// Node allocators of a tree, created with the first node
+struct range_tree_pools {
+  struct pool nodes;                // Inner node allocator, released in bulk on tree destruction
+  struct pool leaves;               // Leaf allocator, released in bulk on tree destruction
 };
 
 struct range_tree {
   struct range_tree_node* root;
   struct range_tree_callback* callback;
   int caps;
+  struct range_tree_pools* pools;   // Node allocators, NULL as long as the tree never had a node
+  struct range_tree_node* finger;   // Leaf of the last lookup, dropped whenever its start offset can't be followed
+  file_offset_t finger_offset;      // Absolute start offset of the finger leaf
+};
+
+// Bottom up construction of a whole tree from an ordered sequence of leaves
+struct range_tree_build {
+  struct range_tree* tree;          // Target tree
+  struct range_tree_node* first;    // First leaf of the chain
+  struct range_tree_node* last;     // Last leaf of the chain
+  size_t count;                     // Number of leaves in chain
 };
 
 struct range_tree* range_tree_create(struct range_tree_callback* callback, int caps);
@@ -69,19 +115,31 @@ void range_tree_create_inplace(struct range_tree* base, struct range_tree_callba
 void range_tree_destroy(struct range_tree* base);
 void range_tree_destroy_inplace(struct range_tree* base);
 
-struct range_tree_node* range_tree_invoke(struct range_tree* base);
+struct range_tree_node* range_tree_invoke(struct range_tree* base, int leaf);
 void range_tree_revoke(struct range_tree* base, struct range_tree_node* node);
 
 void range_tree_fuse(struct range_tree* base, struct range_tree_node* first, struct range_tree_node* last);
 void range_tree_cache_invalidate(struct range_tree* base, struct file_cache* cache);
+void range_tree_rebind(struct range_tree* base, struct fragment* buffer);
+int range_tree_same(struct range_tree* base, struct range_tree* other);
 
+void range_tree_join(struct range_tree* base, struct range_tree_node* node);
 void range_tree_insert(struct range_tree* base, file_offset_t offset, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter, int64_t fuse_id, void* user_data);
+void range_tree_insert_extend(struct range_tree* base, file_offset_t offset, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter);
 void range_tree_insert_split(struct range_tree* base, file_offset_t offset, const uint8_t* text, size_t length, int inserter);
 void range_tree_delete(struct range_tree* base, file_offset_t offset, file_offset_t length, int inserter);
+struct range_tree* range_tree_cut(struct range_tree* base, file_offset_t offset, file_offset_t length);
 struct range_tree* range_tree_copy(struct range_tree* base, file_offset_t offset, file_offset_t length, struct range_tree_callback* callback);
 void range_tree_paste(struct range_tree* base, struct range_tree_node* copy, file_offset_t offset);
 uint8_t* range_tree_raw(struct range_tree* base, file_offset_t start, file_offset_t end);
 
+void range_tree_build_begin(struct range_tree_build* base, struct range_tree* tree);
+void range_tree_build_append(struct range_tree_build* base, struct fragment* buffer, file_offset_t buffer_offset, file_offset_t buffer_length, int inserter, int64_t fuse_id, void* user_data);
+void range_tree_build_take(struct range_tree_build* base, struct range_tree_node* node);
+void range_tree_build_copy(struct range_tree_build* base, struct range_tree_node* root_from, file_offset_t offset_from, file_offset_t length);
+void range_tree_build_end(struct range_tree_build* base);
+struct range_tree_node* range_tree_build_node(struct range_tree* tree, struct range_tree_node** leaf, size_t count);
+
 void range_tree_split(struct range_tree* base, struct range_tree_node** node, file_offset_t split, int invalidate);
 void range_tree_mark(struct range_tree* base, file_offset_t offset, file_offset_t length, int inserter);
 void range_tree_empty(struct range_tree* base);
@@ -92,6 +150,8 @@ void range_tree_reduce(struct range_tree* base, file_offset_t offset, file_offse
 struct range_tree_node* range_tree_marked_next(struct range_tree* base, file_offset_t offset, file_offset_t* low, file_offset_t* high, int skip_first);
 struct range_tree_node* range_tree_marked_prev(struct range_tree* base, file_offset_t offset, file_offset_t* low, file_offset_t* high, int skip_first);
 
+struct range_tree_node* range_tree_find_offset(struct range_tree* base, file_offset_t offset, file_offset_t* diff);
+
 void range_tree_node_print(const struct range_tree_node* node, int depth, int side);
 void range_tree_node_check(const struct range_tree_node* node);
 void range_tree_node_print_root(const struct range_tree_node* node, int depth, int side);
@@ -99,12 +159,18 @@ void range_tree_node_update_lazy(struct range_tree_node* node, struct range_tree
 void range_tree_node_update_calc(struct range_tree_node* node, struct range_tree* tree);
 void range_tree_node_update_calc_all(struct range_tree_node* node, struct range_tree* tree);
 void range_tree_node_destroy(struct range_tree_node* node, struct range_tree* tree);
+void range_tree_node_release(struct range_tree_node* node, struct range_tree* tree);
 struct range_tree_node* range_tree_node_create(struct range_tree_node* parent, struct range_tree* tree, struct range_tree_node* side0, struct range_tree_node* side1, struct fragment* buffer, file_offset_t offset, file_offset_t length, int inserter, int64_t fuse_id, void* user_data);
 struct range_tree_node* range_tree_node_first(struct range_tree_node* node);
 struct range_tree_node* range_tree_node_last(struct range_tree_node* node);
 TIPPSE_INLINE struct range_tree_node* range_tree_node_next(const struct range_tree_node* node) {return node?node->next:NULL;}
 TIPPSE_INLINE struct range_tree_node* range_tree_node_prev(const struct range_tree_node* node) {return node?node->prev:NULL;}
 TIPPSE_INLINE file_offset_t range_tree_node_length(const struct range_tree_node* node) {return node?node->length:0;}
+TIPPSE_INLINE struct range_tree_node_visual* range_tree_node_visual(struct range_tree_node* node) {return ((struct range_tree_node_visual*)node)-1;}
+TIPPSE_INLINE int range_tree_node_summarized(struct range_tree_node* node) {
+  struct range_tree_node_visual* visual = range_tree_node_visual(node);
+  return (visual->summarized && visual->summary_length==node->length && (!(node->inserter&TIPPSE_INSERTER_LEAF) || visual->summary_offset==node->offset))?1:0;
+}
 void range_tree_node_exchange(struct range_tree_node* node, struct range_tree_node* old, struct range_tree_node* update);
 struct range_tree_node* range_tree_node_rotate(struct range_tree_node* node, struct range_tree* tree, int side);
 struct range_tree_node* range_tree_node_balance(struct range_tree_node* node, struct range_tree* tree);
@@ -113,9 +179,11 @@ file_offset_t range_tree_node_offset(const struct range_tree_node* node);
 struct range_tree_node* range_tree_node_find_offset(struct range_tree_node* node, file_offset_t offset, file_offset_t* diff);
 void range_tree_node_invalidate(struct range_tree_node* node, struct range_tree* tree);
 void range_tree_node_cache_invalidate(struct range_tree_node* node, struct range_tree* tree, struct file_cache* cache);
+void range_tree_node_rebind(struct range_tree_node* node, struct range_tree* base, struct fragment* buffer, file_offset_t* offset);
 void range_tree_node_copy_insert(struct range_tree_node* root_from, file_offset_t offset_from, struct range_tree* tree_to, file_offset_t offset_to, file_offset_t length);
 int range_tree_node_marked(const struct range_tree_node* node, file_offset_t offset, file_offset_t length, int inserter);
 struct range_tree_node* range_tree_node_invert_mark(struct range_tree_node* node, struct range_tree* tree, int inserter);
+int range_tree_node_consecutive(const struct range_tree_node* first, const struct range_tree_node* next);
 
 TIPPSE_INLINE file_offset_t range_tree_length(const struct range_tree* base) {return range_tree_node_length(base->root);}
 TIPPSE_INLINE struct range_tree_node* range_tree_first(struct range_tree* base) {return range_tree_node_first(base->root);}
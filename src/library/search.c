@@ -32,7 +32,10 @@ struct search_node* search_node_create(int type) {
   base->stack = NULL;
   base->next = NULL;
   base->forward = NULL;
-  range_tree_create_inplace(&base->set, NULL, 0);
+  range_tree_create_inplace(&base->set, NULL, TIPPSE_RANGETREE_CAPS_SLIM);
+  base->plane = NULL;
+  base->astral = NULL;
+  base->astral_count = 0;
   return base;
 }
 
@@ -60,6 +63,8 @@ void search_node_empty(struct search_node* base) {
   list_destroy_inplace(&base->group_end);
 
   free(base->plain);
+  free(base->plane);
+  free(base->astral);
   range_tree_destroy_inplace(&base->set);
 }
 
@@ -125,6 +130,71 @@ void search_node_set(struct search_node* node, size_t index) {
   range_tree_mark(&node->set, index, 1, TIPPSE_INSERTER_MARK);
 }
 
+// Flatten the huge set into a dense table for the basic plane and a sorted range list for the rest, the search loop doesn't walk the tree
+void search_node_set_compile(struct search_node* node) {
+  free(node->plane);
+  free(node->astral);
+  node->plane = (uint32_t*)malloc(sizeof(uint32_t)*(SEARCH_NODE_SET_PLANE/SEARCH_NODE_SET_BUCKET));
+  memset(node->plane, 0, sizeof(uint32_t)*(SEARCH_NODE_SET_PLANE/SEARCH_NODE_SET_BUCKET));
+  node->astral = NULL;
+  node->astral_count = 0;
+
+  size_t astral = 0;
+  codepoint_t codepoint = 0;
+  struct range_tree_node* range = range_tree_first(&node->set);
+  while (range) {
+    codepoint_t end = codepoint+(codepoint_t)range->length;
+    if (range->inserter&TIPPSE_INSERTER_MARK) {
+      for (codepoint_t n = codepoint; n<end && n<SEARCH_NODE_SET_PLANE; n++) {
+        node->plane[n/SEARCH_NODE_SET_BUCKET] |= ((uint32_t)1)<<(n%SEARCH_NODE_SET_BUCKET);
+      }
+
+      if (end>SEARCH_NODE_SET_PLANE) {
+        astral++;
+      }
+    }
+    codepoint = end;
+    range = range_tree_node_next(range);
+  }
+
+  if (astral==0) {
+    return;
+  }
+
+  node->astral = (codepoint_t*)malloc(sizeof(codepoint_t)*2*astral);
+  codepoint = 0;
+  range = range_tree_first(&node->set);
+  while (range) {
+    codepoint_t end = codepoint+(codepoint_t)range->length;
+    if ((range->inserter&TIPPSE_INSERTER_MARK) && end>SEARCH_NODE_SET_PLANE) {
+      node->astral[node->astral_count*2+0] = (codepoint>SEARCH_NODE_SET_PLANE)?codepoint:SEARCH_NODE_SET_PLANE;
+      // Undecodable input lies above the set and matches if the final range does
+      node->astral[node->astral_count*2+1] = (end>=SEARCH_NODE_SET_CODES)?(codepoint_t)~0:end;
+      node->astral_count++;
+    }
+    codepoint = end;
+    range = range_tree_node_next(range);
+  }
+}
+
+// Binary search code point above the basic plane in the range list
+int search_node_set_check_astral(struct search_node* node, codepoint_t index) {
+  size_t low = 0;
+  size_t high = node->astral_count;
+  while (low<high) {
+    size_t mid = (low+high)/2;
+    if (index<node->astral[mid*2+0]) {
+      high = mid;
+    } else if (index>=node->astral[mid*2+1]) {
+      low = mid+1;
+    } else {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 // Decode a huge set from choosen rle stream (usally to create character classes) and invert if needed
 void search_node_set_decode_rle(struct search_node* node, int invert, uint8_t* rle) {
   file_offset_t codepoint = 0;
@@ -1219,6 +1289,8 @@ void search_prepare(struct search* base, struct search_node* node, struct search
       codepoint += range->length;
       range = range_tree_node_next(range);
     }
+  } else if (node->type&SEARCH_NODE_TYPE_SET) {
+    search_node_set_compile(node);
   }
 
   if (node->group_start.first) {
@@ -1465,11 +1537,6 @@ TIPPSE_INLINE int search_node_bitset_check(struct search_node* node, uint8_t ind
   return (int)((node->bitset[index/SEARCH_NODE_SET_BUCKET]>>(index%SEARCH_NODE_SET_BUCKET))&1);
 }
 
-// Loop helper to find the code point in the code point set accordingly to the index
-TIPPSE_INLINE int search_node_set_check(struct search_node* node, codepoint_t index) {
-  return range_tree_node_marked(node->set.root, (file_offset_t)index, 1, TIPPSE_INSERTER_MARK);
-}
-
 // Next stack entry, create new stack and frame if needed
 TIPPSE_INLINE void search_find_loop_enter(struct search* base, struct search_stack** load, struct search_stack** start, struct search_stack** end, struct list_node** frame) {
   *load = (*load)+1;
@@ -22,6 +22,7 @@
 
 #define SEARCH_NODE_SET_CODES UNICODE_CODEPOINT_MAX
 #define SEARCH_NODE_SET_BUCKET (sizeof(uint32_t)*8)
+#define SEARCH_NODE_SET_PLANE 0x10000
 #define SEARCH_NODE_TYPE_NATIVE_COUNT 8
 
 struct search_stack;
@@ -50,6 +51,9 @@ struct search_node {
   struct stream end;      // end of group content during scan
   struct range_tree set; // matching codepoints/bytes
   uint32_t bitset[256/SEARCH_NODE_SET_BUCKET+1]; // simple bit table for byte matching
+  uint32_t* plane;        // bit table of the basic multilingual plane for codepoint matching
+  codepoint_t* astral;    // sorted start and end pairs of matching codepoints above the basic plane
+  size_t astral_count;    // number of pairs
   size_t group;           // group number in back reference
 };
 
@@ -95,8 +99,19 @@ void search_node_destroy_recursive(struct search_node* node);
 int search_node_count(struct search_node* node);
 void search_node_set_build(struct search_node* node);
 void search_node_set(struct search_node* node, size_t index);
+void search_node_set_compile(struct search_node* node);
+int search_node_set_check_astral(struct search_node* node, codepoint_t index);
 void search_node_set_decode_rle(struct search_node* node, int invert, uint8_t* rle);
 
+// Loop helper to find the code point in the code point set accordingly to the index
+TIPPSE_INLINE int search_node_set_check(struct search_node* node, codepoint_t index) {
+  if (LIKELY(index<SEARCH_NODE_SET_PLANE)) {
+    return (int)((node->plane[index/SEARCH_NODE_SET_BUCKET]>>(index%SEARCH_NODE_SET_BUCKET))&1);
+  }
+
+  return search_node_set_check_astral(node, index);
+}
+
 struct search* search_create(int reverse, struct encoding* output_encoding);
 struct search* search_create_plain(int ignore_case, int reverse, struct stream* needle, struct encoding* needle_encoding, struct encoding* output_encoding);
 struct search* search_create_regex(int ignore_case, int reverse, struct stream* needle, struct encoding* needle_encoding, struct encoding* output_encoding);
@@ -18,6 +18,7 @@ void stream_from_plain(struct stream* base, const uint8_t* plain, size_t size) {
 void stream_from_page(struct stream* base, const struct range_tree_node* buffer, file_offset_t displacement) {
   base->type = STREAM_TYPE_PAGED;
   base->buffer = buffer;
+  base->prefetch = 0;
   base->displacement = displacement%FILE_CACHE_PAGE_SIZE;
   base->page_offset = displacement-base->displacement;
   stream_reference_page(base);
@@ -27,6 +28,7 @@ void stream_from_page(struct stream* base, const struct range_tree_node* buffer,
 void stream_from_file(struct stream* base, struct file_cache* cache, file_offset_t offset) {
   base->type = STREAM_TYPE_FILE;
   base->file.cache = cache;
+  base->prefetch = 0;
   base->displacement = offset%FILE_CACHE_PAGE_SIZE;
   base->page_offset = 0;
   base->file.offset = offset-base->displacement;
@@ -101,6 +103,19 @@ void stream_unreference_page(struct stream* base) {
   }
 }
 
+// Return file cache holding the current page, NULL if the page lives in memory
+struct file_cache* stream_page_cache(const struct stream* base) {
+  if (base->type==STREAM_TYPE_PAGED) {
+    if (base->buffer && base->buffer->buffer && base->buffer->buffer->type==FRAGMENT_FILE) {
+      return base->buffer->buffer->cache;
+    }
+  } else if (base->type==STREAM_TYPE_FILE) {
+    return base->file.cache;
+  }
+
+  return NULL;
+}
+
 // Return stream offset (plain stream)
 size_t stream_offset_plain(const struct stream* base) {
   return base->displacement;
@@ -167,6 +182,7 @@ void stream_forward_oob(struct stream* base, size_t length) {
   if (base->type==STREAM_TYPE_PLAIN) {
   } else if (base->type==STREAM_TYPE_PAGED) {
     if (stream_rereference_page(base)) {
+      stream_prefetch(base);
       return;
     }
 
@@ -191,16 +207,37 @@ void stream_forward_oob(struct stream* base, size_t length) {
         break;
       }
     }
+    stream_prefetch(base);
   } else if (base->type==STREAM_TYPE_FILE) {
     while (base->cache_length>=FILE_CACHE_PAGE_SIZE && base->displacement>=FILE_CACHE_PAGE_SIZE) {
       file_cache_revoke(base->file.cache, base->cache_node);
       base->displacement -= FILE_CACHE_PAGE_SIZE;
       base->file.offset += FILE_CACHE_PAGE_SIZE;
       base->cache_node = file_cache_invoke(base->file.cache, base->file.offset, FILE_CACHE_PAGE_SIZE, &base->plain, &base->cache_length);
+      stream_prefetch(base);
     }
   }
 }
 
+// Stream moved forward into another page, keep the read ahead window of the file in front of it
+void stream_prefetch(struct stream* base) {
+  struct file_cache* cache = stream_page_cache(base);
+  if (!cache) {
+    return;
+  }
+
+  file_offset_t position = (base->type==STREAM_TYPE_FILE)?base->file.offset:base->buffer->buffer->offset+base->buffer->offset+base->page_offset;
+  if (position>base->prefetch || position+FILE_CACHE_PREFETCH<base->prefetch) {
+    // Not following the last window, start a new one
+    base->prefetch = position;
+  }
+
+  if (base->prefetch-position<FILE_CACHE_PREFETCH/2) {
+    file_cache_prefetch(cache, base->prefetch, position+FILE_CACHE_PREFETCH-base->prefetch);
+    base->prefetch = position+FILE_CACHE_PREFETCH;
+  }
+}
+
 // Back to previous leaf in tree if direct reverse failed
 void stream_reverse_oob(struct stream* base, size_t length) {
   base->displacement -= length;
@@ -19,6 +19,7 @@ struct stream {
   size_t cache_length;                  // length of buffer
   file_offset_t page_offset;            // offset in page
   struct file_cache_node* cache_node;   // file cache node
+  file_offset_t prefetch;               // file position up to which read ahead was requested
 
   union {
     const struct range_tree_node* buffer; // page in tree, if paged stream
@@ -38,6 +39,8 @@ void stream_clone(struct stream* base, struct stream* src);
 bool_t stream_rereference_page(struct stream* base);
 void stream_reference_page(struct stream* base);
 void stream_unreference_page(struct stream* base);
+struct file_cache* stream_page_cache(const struct stream* base);
+void stream_prefetch(struct stream* base);
 
 size_t stream_offset_plain(const struct stream* base);
 file_offset_t stream_offset_page(const struct stream* base);
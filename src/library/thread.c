@@ -29,6 +29,17 @@ void thread_shutdown(struct thread* thread) {
   thread->shutdown = 1;
 }
 
+int thread_processors(void) {
+#ifdef _WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+#else
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count>0)?(int)count:1;
+#endif
+}
+
 #ifdef _WINDOWS
 DWORD WINAPI thread_entry(void* data) {
 #else
@@ -5,6 +5,7 @@
 #include <windows.h>
 #else
 #include <pthread.h>
+#include <unistd.h>
 #endif
 #include "types.h"
 
@@ -26,6 +27,7 @@ struct thread {
 void thread_create_inplace(struct thread* thread, thread_callback callback, void* data);
 void thread_destroy_inplace(struct thread* thread);
 void thread_shutdown(struct thread* thread);
+int thread_processors(void);
 #ifdef _WINDOWS
 DWORD WINAPI thread_entry(void* data);
 #else
@@ -79,6 +79,7 @@ struct encoding;
 struct file;
 struct file_cache;
 struct file_cache_node;
+struct file_sink;
 struct fragment;
 struct list;
 struct list_node;
@@ -92,5 +93,6 @@ struct trie;
 struct trie_node;
 struct unicode_sequence;
 struct unicode_sequencer;
+struct watch;
 
 #endif /* #ifndef TIPPSE_LIBRARY_TYPES_H */
@@ -0,0 +1,250 @@
+// Tippse - Watch - Notify about changes of files and directory listings
+
+#include "watch.h"
+
+#include "misc.h"
+
+#if WATCH_INOTIFY
+#define WATCH_INOTIFY_MASK (IN_MODIFY|IN_ATTRIB|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF)
+#endif
+
+// Create empty watch, the kernel interface is opened if available
+struct watch* watch_create(void) {
+  struct watch* base = (struct watch*)malloc(sizeof(struct watch));
+#if WATCH_INOTIFY
+  base->descriptor = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+#else
+  base->descriptor = -1;
+#endif
+  list_create_inplace(&base->directories, sizeof(struct watch_directory));
+  list_create_inplace(&base->entries, sizeof(struct watch_entry));
+  base->tick_poll = 0;
+  return base;
+}
+
+// Remove all entries and close the kernel interface
+void watch_destroy(struct watch* base) {
+  while (base->entries.first) {
+    watch_remove(base, base->entries.first);
+  }
+
+#if WATCH_INOTIFY
+  if (base->descriptor!=-1) {
+    close(base->descriptor);
+  }
+#endif
+
+  list_destroy_inplace(&base->directories);
+  list_destroy_inplace(&base->entries);
+  free(base);
+}
+
+// Observe a file or the listing of a directory, files are observed through the directory they live in
+struct list_node* watch_add(struct watch* base, const char* path, int listing) {
+  char* path_directory;
+  char* name = NULL;
+  if (listing) {
+    path_directory = strdup(path);
+  } else {
+    path_directory = strip_file_name(path);
+    if (!*path_directory) {
+      free(path_directory);
+      path_directory = strdup((*path=='/')?"/":".");
+    }
+
+    name = extract_file_name(path);
+  }
+
+  struct list_node* directory = base->directories.first;
+  while (directory && strcmp(((struct watch_directory*)list_object(directory))->path, path_directory)!=0) {
+    directory = directory->next;
+  }
+
+  if (directory) {
+    free(path_directory);
+  } else {
+    directory = list_insert_empty(&base->directories, NULL);
+    struct watch_directory* observed = (struct watch_directory*)list_object(directory);
+    observed->path = path_directory;
+    observed->count = 0;
+    observed->descriptor = -1;
+#if WATCH_INOTIFY
+    if (base->descriptor!=-1) {
+      observed->descriptor = inotify_add_watch(base->descriptor, path_directory, WATCH_INOTIFY_MASK);
+    }
+#endif
+  }
+
+  ((struct watch_directory*)list_object(directory))->count++;
+
+  struct list_node* node = list_insert_empty(&base->entries, NULL);
+  struct watch_entry* entry = (struct watch_entry*)list_object(node);
+  entry->directory = directory;
+  entry->name = name;
+  entry->changed = 0;
+  watch_attributes(path, &entry->modification_time, &entry->size);
+  return node;
+}
+
+// Stop observing, the directory is released with its last entry
+void watch_remove(struct watch* base, struct list_node* node) {
+  struct watch_entry* entry = (struct watch_entry*)list_object(node);
+  struct watch_directory* observed = (struct watch_directory*)list_object(entry->directory);
+  observed->count--;
+  if (observed->count==0) {
+    free(observed->path);
+#if WATCH_INOTIFY
+    int descriptor = observed->descriptor;
+#endif
+    list_remove(&base->directories, entry->directory);
+#if WATCH_INOTIFY
+    struct list_node* directory = base->directories.first;
+    while (directory && ((struct watch_directory*)list_object(directory))->descriptor!=descriptor) {
+      directory = directory->next;
+    }
+
+    if (descriptor!=-1 && !directory) {
+      inotify_rm_watch(base->descriptor, descriptor);
+    }
+#endif
+  }
+
+  free(entry->name);
+  list_remove(&base->entries, node);
+}
+
+// Descriptor that becomes readable on changes, -1 if the caller has to poll
+int watch_descriptor(struct watch* base) {
+  return base->descriptor;
+}
+
+// Read pending kernel events and mark the affected entries, returns 1 if any entry changed
+int watch_process(struct watch* base) {
+  int changed = 0;
+#if WATCH_INOTIFY
+  if (base->descriptor==-1) {
+    return 0;
+  }
+
+  union {
+    struct inotify_event event;
+    char data[4096];
+  } buffer;
+
+  while (1) {
+    ssize_t length = read(base->descriptor, &buffer, sizeof(buffer));
+    if (length<=0) {
+      break;
+    }
+
+    char* data = &buffer.data[0];
+    while (data<&buffer.data[length]) {
+      struct inotify_event* event = (struct inotify_event*)data;
+      if (event->mask&IN_Q_OVERFLOW) {
+        changed |= watch_mark(base, NULL, NULL);
+      } else {
+        // Different paths of the same directory share the kernel watch
+        struct list_node* directory = base->directories.first;
+        while (directory) {
+          struct watch_directory* observed = (struct watch_directory*)list_object(directory);
+          if (observed->descriptor==event->wd) {
+            if (event->mask&IN_IGNORED) {
+              // Directory is gone, the entries are polled from now on
+              observed->descriptor = -1;
+              changed |= watch_mark(base, directory, NULL);
+            } else {
+              changed |= watch_mark(base, directory, event->len?&event->name[0]:NULL);
+            }
+          }
+
+          directory = directory->next;
+        }
+      }
+
+      data += sizeof(struct inotify_event)+event->len;
+    }
+  }
+#endif
+
+  return changed;
+}
+
+// Compare the attributes of entries without kernel notification from time to time, returns 1 if any entry changed
+int watch_poll(struct watch* base) {
+  int64_t tick = tick_count();
+  if (tick<base->tick_poll) {
+    return 0;
+  }
+
+  base->tick_poll = tick+tick_ms(WATCH_POLL_INTERVAL);
+
+  int changed = 0;
+  struct list_node* node = base->entries.first;
+  while (node) {
+    struct watch_entry* entry = (struct watch_entry*)list_object(node);
+    struct watch_directory* observed = (struct watch_directory*)list_object(entry->directory);
+    if (observed->descriptor==-1) {
+      char* path = entry->name?combine_path_file(observed->path, entry->name):strdup(observed->path);
+      int64_t modification_time;
+      int64_t size;
+      watch_attributes(path, &modification_time, &size);
+      free(path);
+      if (modification_time!=entry->modification_time || size!=entry->size) {
+        entry->modification_time = modification_time;
+        entry->size = size;
+        entry->changed = 1;
+        changed = 1;
+      }
+    }
+
+    node = node->next;
+  }
+
+  return changed;
+}
+
+// Return and reset change state of entry
+int watch_changed(struct list_node* node) {
+  struct watch_entry* entry = (struct watch_entry*)list_object(node);
+  int changed = entry->changed;
+  entry->changed = 0;
+  return changed;
+}
+
+// Mark entries of a directory (or all if NULL) as changed, a name limits the files but the listing is always affected
+int watch_mark(struct watch* base, struct list_node* directory, const char* name) {
+  int changed = 0;
+  struct list_node* node = base->entries.first;
+  while (node) {
+    struct watch_entry* entry = (struct watch_entry*)list_object(node);
+    if ((!directory || entry->directory==directory) && (!name || !entry->name || strcmp(entry->name, name)==0)) {
+      entry->changed = 1;
+      changed = 1;
+    }
+
+    node = node->next;
+  }
+
+  return changed;
+}
+
+// Get modification time and size of a file or directory, both are -1 if it doesn't exist
+void watch_attributes(const char* path, int64_t* modification_time, int64_t* size) {
+  *modification_time = -1;
+  *size = -1;
+#ifdef _WINDOWS
+  wchar_t* os = string_system(path);
+  WIN32_FILE_ATTRIBUTE_DATA info;
+  if (GetFileAttributesExW(os, GetFileExInfoStandard, &info)) {
+    *modification_time = (int64_t)(((uint64_t)info.ftLastWriteTime.dwHighDateTime<<32)|info.ftLastWriteTime.dwLowDateTime);
+    *size = (int64_t)(((uint64_t)info.nFileSizeHigh<<32)|info.nFileSizeLow);
+  }
+  free(os);
+#else
+  struct stat info;
+  if (stat(path, &info)==0) {
+    *modification_time = (int64_t)info.st_mtime;
+    *size = (int64_t)info.st_size;
+  }
+#endif
+}
@@ -0,0 +1,64 @@
+#ifndef TIPPSE_WATCH_H
+#define TIPPSE_WATCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "types.h"
+#include "list.h"
+
+// Changes are signalled by the kernel on Linux, other platforms poll the file attributes
+#if defined(__linux__) && !defined(_EMSCRIPTEN)
+#define WATCH_INOTIFY 1
+#include <sys/inotify.h>
+#else
+#define WATCH_INOTIFY 0
+#endif
+
+// Interval between two polls of the fallback in milliseconds
+#define WATCH_POLL_INTERVAL 1000
+
+// Directory observed on behalf of its entries
+struct watch_directory {
+  char* path;                   // name of directory
+  int descriptor;               // inotify watch, -1 if polled
+  size_t count;                 // number of entries inside
+};
+
+// Observed file or directory listing
+struct watch_entry {
+  struct list_node* directory;  // directory the entry belongs to
+  char* name;                   // file name inside directory, NULL for the listing itself
+  int changed;                  // change seen since last check
+  int64_t modification_time;    // last seen modification time, only used while polling
+  int64_t size;                 // last seen size, only used while polling
+};
+
+struct watch {
+  int descriptor;               // inotify instance, -1 if all entries are polled
+  struct list directories;      // observed directories
+  struct list entries;          // observed entries
+  int64_t tick_poll;            // next poll of the fallback
+};
+
+struct watch* watch_create(void);
+void watch_destroy(struct watch* base);
+struct list_node* watch_add(struct watch* base, const char* path, int listing);
+void watch_remove(struct watch* base, struct list_node* entry);
+int watch_descriptor(struct watch* base);
+int watch_process(struct watch* base);
+int watch_poll(struct watch* base);
+int watch_changed(struct list_node* entry);
+int watch_mark(struct watch* base, struct list_node* directory, const char* name);
+void watch_attributes(const char* path, int64_t* modification_time, int64_t* size);
+
+#endif /* #ifndef TIPPSE_WATCH_H */
@@ -20,15 +20,20 @@
 #include "clipboard.h"
 #include "documentfile.h"
 #include "editor.h"
+#include "library/count.h"
 #include "library/encoding/utf8.h"
 #include "library/file.h"
+#include "library/filecache.h"
+#include "library/fragment.h"
 #include "library/misc.h"
 #include "screen.h"
 #include "library/search.h"
 #include "library/unicode.h"
+#include "library/watch.h"
 
 #ifdef _PERFORMANCE
 #include "splitter.h"
+#include "library/thread.h"
 #endif
 
 struct tippse_ansi_key {
@@ -170,8 +175,32 @@ void tippse_update_signal(struct document_file* file) {
   UNUSED(write(tippse_pipefd[1], &file, sizeof(struct document_file*)));
 }
 
+#ifdef _PERFORMANCE
+struct tippse_perf_cache {
+  struct file_cache* cache;   // cache to read from
+  size_t sum;                 // checksum of read bytes
+};
+
+// Benchmark thread, pages stay resident so only the cache hit path is measured
+void tippse_perf_cache_entry(struct thread* thread) {
+  struct tippse_perf_cache* perf = (struct tippse_perf_cache*)thread->data;
+  uint32_t seed = (uint32_t)(uintptr_t)perf;
+  for (int n = 0; n<1000000; n++) {
+    seed = seed*1103515245u+12345u;
+    const uint8_t* buffer;
+    size_t length;
+    struct file_cache_node* node = file_cache_invoke(perf->cache, (file_offset_t)((seed>>8)%16)*FILE_CACHE_PAGE_SIZE, FILE_CACHE_PAGE_SIZE, &buffer, &length);
+    perf->sum += length?buffer[0]:0;
+    file_cache_revoke(perf->cache, node);
+  }
+}
+#endif
+
 int main(int argc, const char** argv) {
   encoding_init();
+  count_init();
+  fragment_init();
+  file_cache_init();
   static char base_path[PATH_MAX];
   if (!realpath(".", &base_path[0])) {
     base_path[0] = '.';
@@ -196,7 +225,6 @@ int main(int argc, const char** argv) {
 
   // screen_character_width_detect(screen);
 
-  int bracket_paste = 0;
   int mouse_buttons = 0;
   int mouse_buttons_old = 0;
   int mouse_x = 0;
@@ -204,6 +232,7 @@ int main(int argc, const char** argv) {
 
   //encoding_utf8_build_tables();
 #ifndef _PERFORMANCE // allow human input :)
+  int bracket_paste = 0;
   uint8_t input_buffer[1024];
   size_t input_pos = 0;
   int64_t ansi_timeout = 0;
@@ -244,6 +273,13 @@ int main(int argc, const char** argv) {
       FD_SET(STDIN_FILENO, &set_read);
       FD_SET(tippse_pipefd[0], &set_read);
       int nfds = tippse_pipefd[0];
+      int watch = watch_descriptor(editor->watch);
+      if (watch!=-1) {
+        FD_SET(watch, &set_read);
+        if (watch>nfds) {
+          nfds = watch;
+        }
+      }
 
       int ret = select(nfds+1, &set_read, NULL, NULL, &tv);
       if (ret>0) {
@@ -267,6 +303,10 @@ int main(int argc, const char** argv) {
             document_file_flush_pipe(file);
           }
         }
+
+        if (watch!=-1 && FD_ISSET(watch, &set_read)) {
+          editor_watch(editor);
+        }
       }
 
       if (ansi_timeout && tick_count()>ansi_timeout) {
@@ -432,8 +472,8 @@ int main(int argc, const char** argv) {
   {
     int64_t tick = tick_count();
     struct stream stream;
-    stream_from_page(&stream, range_tree_node_first(editor->document->file->buffer), 0);
-    size_t length = range_tree_node_length(editor->document->file->buffer);
+    stream_from_page(&stream, range_tree_first(&editor->document->file->buffer), 0);
+    size_t length = range_tree_length(&editor->document->file->buffer);
     uint8_t sum = 0;
     while (length-- >0) {
       sum += stream_read_forward(&stream);
@@ -444,8 +484,8 @@ int main(int argc, const char** argv) {
   {
     int64_t tick = tick_count();
     struct stream stream;
-    stream_from_page(&stream, range_tree_node_first(editor->document->file->buffer), 0);
-    size_t length = range_tree_node_length(editor->document->file->buffer);
+    stream_from_page(&stream, range_tree_first(&editor->document->file->buffer), 0);
+    size_t length = range_tree_length(&editor->document->file->buffer);
     codepoint_t sum = 0;
     struct encoding* encoding = editor->document->file->encoding;
     while (length >0) {
@@ -463,8 +503,8 @@ int main(int argc, const char** argv) {
   {
     int64_t tick = tick_count();
     struct stream stream;
-    stream_from_page(&stream, range_tree_node_first(editor->document->file->buffer), 0);
-    size_t length = range_tree_node_length(editor->document->file->buffer);
+    stream_from_page(&stream, range_tree_first(&editor->document->file->buffer), 0);
+    size_t length = range_tree_length(&editor->document->file->buffer);
     codepoint_t sum = 0;
     struct encoding* encoding = editor->document->file->encoding;
     struct unicode_sequencer sequencer;
@@ -482,6 +522,63 @@ int main(int argc, const char** argv) {
     stream_destroy(&stream);
     fprintf(stderr, "    Sequenced: %d   / %d\r\n", (int)(tick_count()-tick), (int)sum);
   }
+  {
+    // Throughput of the counting kernels over the document repeated to 64 MB
+    size_t length = 64*1024*1024;
+    uint8_t* text = (uint8_t*)malloc(length);
+    size_t filled = 0;
+    struct stream stream;
+    stream_from_page(&stream, range_tree_first(&editor->document->file->buffer), 0);
+    size_t document = range_tree_length(&editor->document->file->buffer);
+    while (filled<length && filled<document) {
+      text[filled++] = stream_read_forward(&stream);
+    }
+    stream_destroy(&stream);
+
+    if (filled==0) {
+      text[filled++] = '\n';
+    }
+
+    while (filled<length) {
+      size_t copy = (filled<length-filled)?filled:length-filled;
+      memcpy(text+filled, text, copy);
+      filled += copy;
+    }
+
+    for (int kernel = 0; kernel<COUNT_KERNEL_MAX; kernel++) {
+      if (count_select(kernel)!=kernel) {
+        continue;
+      }
+
+      double speed[3];
+      size_t sum = 0;
+      for (int type = 0; type<3; type++) {
+        int64_t tick = tick_count();
+        for (int n = 0; n<16; n++) {
+          if (type==0) {
+            sum += count_bytes(text, length, '\n');
+          } else if (type==1) {
+            sum += count_utf8(text, length);
+          } else {
+            // Walk all ASCII spans, the byte that ends a span is skipped
+            size_t pos = 0;
+            while (pos<length) {
+              pos += count_ascii(text+pos, length-pos)+1;
+              sum++;
+            }
+          }
+        }
+
+        int64_t elapsed = tick_count()-tick;
+        speed[type] = (double)length*16.0/(double)(elapsed?elapsed:1)*(double)tick_ms(1000)/1e9;
+      }
+
+      fprintf(stderr, "%13s: %.2f / %.2f / %.2f GB/s newline / UTF-8 / ASCII   / %d\r\n", count_name(kernel), speed[0], speed[1], speed[2], (int)sum);
+    }
+
+    count_init();
+    free(text);
+  }
   {
     int64_t tick = tick_count();
     for (int n = 0; n<900; n++) {
@@ -501,11 +598,116 @@ int main(int argc, const char** argv) {
     editor_keypress(editor, TIPPSE_KEY_LAST|TIPPSE_KEY_MOD_CTRL, 0, mouse_buttons, mouse_buttons_old, mouse_x, mouse_y);
     fprintf(stderr, "Last location: %d\r\n", (int)(tick_count()-tick));
   }
+  {
+    // Neighbored lookups like typing or scrolling do, root descent against finger search
+    struct range_tree* buffer = &editor->document->file->buffer;
+    file_offset_t length = range_tree_length(buffer);
+    file_offset_t displacement;
+    size_t sum = 0;
+    int64_t tick = tick_count();
+    for (int n = 0; n<16; n++) {
+      for (file_offset_t offset = 0; offset<length; offset += 16) {
+        sum += (size_t)range_tree_node_find_offset(buffer->root, offset, &displacement)->length;
+      }
+    }
+    fprintf(stderr, "  Root lookup: %d   / %d\r\n", (int)(tick_count()-tick), (int)sum);
+
+    sum = 0;
+    tick = tick_count();
+    for (int n = 0; n<16; n++) {
+      for (file_offset_t offset = 0; offset<length; offset += 16) {
+        sum += (size_t)range_tree_find_offset(buffer, offset, &displacement)->length;
+      }
+    }
+    fprintf(stderr, "Finger lookup: %d   / %d\r\n", (int)(tick_count()-tick), (int)sum);
+  }
+  {
+    // Character class membership per decoded code point, range tree walk against flat table
+    const char* needle = "[\\w\\-.]";
+    struct stream needle_stream;
+    stream_from_plain(&needle_stream, (const uint8_t*)needle, strlen(needle));
+    struct encoding* encoding = editor->document->file->encoding;
+    struct search* search = search_create_regex(0, 0, &needle_stream, encoding_utf8_static(), encoding);
+    struct search_node* node = search->root;
+    while (node && (!(node->type&SEARCH_NODE_TYPE_SET) || (node->type&SEARCH_NODE_TYPE_BYTE))) {
+      node = node->next;
+    }
+
+    for (int mode = 0; node && mode<2; mode++) {
+      int64_t tick = tick_count();
+      struct stream stream;
+      stream_from_page(&stream, range_tree_first(&editor->document->file->buffer), 0);
+      size_t length = range_tree_length(&editor->document->file->buffer);
+      size_t sum = 0;
+      while (length>0) {
+        size_t size;
+        codepoint_t cp = (*encoding->decode)(encoding, &stream, &size);
+        sum += (size_t)(mode?search_node_set_check(node, cp):range_tree_node_marked(node->set.root, (file_offset_t)cp, 1, TIPPSE_INSERTER_MARK));
+        if (size>=length) {
+          break;
+        }
+
+        length -= size;
+      }
+      stream_destroy(&stream);
+      fprintf(stderr, "%s: %d   / %d\r\n", mode?"  Class table":"   Class tree", (int)(tick_count()-tick), (int)sum);
+    }
+
+    search_destroy(search);
+  }
+  if (editor->document->file->cache) {
+    // Concurrent page lookups of several threads on the same file, every thread does the same amount of work
+    for (size_t threads = 1; threads<=8; threads *= 2) {
+      struct thread thread[8];
+      struct tippse_perf_cache perf[8];
+      int64_t tick = tick_count();
+      for (size_t n = 0; n<threads; n++) {
+        perf[n].cache = editor->document->file->cache;
+        perf[n].sum = 0;
+        thread_create_inplace(&thread[n], tippse_perf_cache_entry, &perf[n]);
+      }
+
+      size_t sum = 0;
+      for (size_t n = 0; n<threads; n++) {
+        thread_destroy_inplace(&thread[n]);
+        sum += perf[n].sum;
+      }
+      fprintf(stderr, "Cache threads %d: %d   / %d\r\n", (int)threads, (int)(tick_count()-tick), (int)sum);
+    }
+
+    // Hex view scrolling to random positions, every line of a screen looks up its page again
+    // A separate cache without mapping copies the pages, the budget is raised beside the pages of the other benchmarks
+    // and positions stay within it so lookups hit the page table
+    struct file_cache* cache = file_cache_create(editor->document->file->cache->filename);
+    file_cache_unmap(cache);
+    file_cache_budget(FILE_CACHE_BUDGET*2);
+    file_offset_t length = cache->map_length<FILE_CACHE_BUDGET/2?cache->map_length:FILE_CACHE_BUDGET/2;
+    length = length?length:1;
+    int64_t tick = tick_count();
+    uint32_t seed = 1;
+    size_t sum = 0;
+    for (int n = 0; n<100000; n++) {
+      seed = seed*1103515245u+12345u;
+      file_offset_t offset = ((file_offset_t)seed*7919u)%length;
+      for (file_offset_t line = 0; line<64; line++) {
+        const uint8_t* buffer;
+        size_t size;
+        struct file_cache_node* node = file_cache_invoke(cache, offset+line*16, 16, &buffer, &size);
+        sum += size;
+        file_cache_revoke(cache, node);
+      }
+    }
+    fprintf(stderr, "   Hex scroll: %d   / %d\r\n", (int)(tick_count()-tick), (int)sum);
+    file_cache_dereference(cache);
+    file_cache_budget(FILE_CACHE_BUDGET);
+  }
 #endif
 
   editor_destroy(editor);
   screen_destroy(screen);
   clipboard_free();
+  file_cache_free();
+  fragment_free();
   unicode_free();
   encoding_free();
 
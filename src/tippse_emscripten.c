@@ -14,10 +14,13 @@
 #include "types.h"
 
 #include "clipboard.h"
+#include "count.h"
 #include "documentfile.h"
 #include "editor.h"
 #include "encoding/utf8.h"
 #include "file.h"
+#include "filecache.h"
+#include "fragment.h"
 #include "misc.h"
 #include "screen.h"
 #include "search.h"
@@ -36,6 +39,9 @@ int EMSCRIPTEN_KEEPALIVE main(int argc, const char** argv) {
 
 void EMSCRIPTEN_KEEPALIVE tippse_init() {
   encoding_init();
+  count_init();
+  fragment_init();
+  file_cache_init();
   base_path = realpath(".", NULL);
 
   unicode_init();
@@ -64,6 +70,8 @@ void EMSCRIPTEN_KEEPALIVE tippse_free() {
   editor_destroy(editor);
   screen_destroy(screen);
   clipboard_free();
+  file_cache_free();
+  fragment_free();
   unicode_free();
   free(base_path);
   encoding_free();
@@ -6,8 +6,11 @@
 #include <windows.h>
 #include "types.h"
 
+#include "library/filecache.h"
+#include "library/fragment.h"
 #include "library/misc.h"
 #include "editor.h"
+#include "library/count.h"
 #include "library/encoding/utf8.h"
 #include "screen.h"
 #include "search.h"
@@ -231,6 +234,9 @@ void tippse_update_signal(struct document_file* file) {
 
 int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, char* command_line, int show) {
   encoding_init();
+  count_init();
+  fragment_init();
+  file_cache_init();
   char* base_path = realpath(".", NULL);
 
   printf("Base: %s\r\n", base_path);
@@ -322,6 +328,8 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, char* command_li
   editor_destroy(base.editor);
   screen_destroy(base.screen);
   clipboard_free();
+  file_cache_free();
+  fragment_free();
   unicode_free();
   free(base_path);
   encoding_free();
@@ -13,6 +13,7 @@ struct document;
 struct document_file;
 struct document_hex;
 struct document_text;
+struct document_text_layout;
 struct document_text_render_info;
 struct document_undo;
 struct document_view;
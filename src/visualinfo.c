@@ -64,6 +64,8 @@ void visual_info_combine(struct document_view* view, struct visual_info* visuals
     visuals->indentation_extra = left->indentation_extra+right->indentation_extra;
   }
 
+  // Content of both pages has to be known as ASCII, otherwise it is checked again
+  visuals->ascii = (left->ascii==VISUAL_ASCII_YES && right->ascii==VISUAL_ASCII_YES)?VISUAL_ASCII_YES:VISUAL_ASCII_UNKNOWN;
   visuals->detail_before = left->detail_before;
   visuals->detail_after = ((left->detail_after&right->detail_after)&VISUAL_DETAIL_WHITESPACED_COMPLETE)|((left->detail_after|right->detail_after)&(VISUAL_DETAIL_WHITESPACED_START|VISUAL_DETAIL_STOPPED_INDENTATION|VISUAL_DETAIL_INDENTATION|VISUAL_DETAIL_NEWLINE));
 
@@ -111,12 +113,14 @@ void visual_info_invalidate(struct document_view* view, struct range_tree_node*
 
   struct visual_info* visuals = document_view_visual_create(view, node, tree);
   visuals->dirty = VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+  visuals->ascii = VISUAL_ASCII_UNKNOWN;
   file_offset_t rewind = visuals->rewind;
 
   struct range_tree_node* invalidate = range_tree_node_next(node);
   if (invalidate) {
     struct visual_info* visuals = document_view_visual_create(view, invalidate, tree);
     visuals->dirty = VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+    visuals->ascii = VISUAL_ASCII_UNKNOWN;
     range_tree_node_update_calc_all(invalidate, tree);
   }
 
@@ -135,6 +139,7 @@ void visual_info_invalidate(struct document_view* view, struct range_tree_node*
 
     struct visual_info* visuals = document_view_visual_create(view, invalidate, tree);
     visuals->dirty = VISUAL_DIRTY_UPDATE|VISUAL_DIRTY_LEFT;
+    visuals->ascii = VISUAL_ASCII_UNKNOWN;
     range_tree_node_update_calc_all(invalidate, tree);
     if (invalidate->length>rewind) {
       break;
@@ -35,6 +35,11 @@
 #define VISUAL_DIRTY_SPLITTED 0x4
 #define VISUAL_DIRTY_LEFT 0x8
 
+// Page content classification for the ASCII layout path
+#define VISUAL_ASCII_UNKNOWN 0
+#define VISUAL_ASCII_YES 1
+#define VISUAL_ASCII_NO 2
+
 // Return flags for document renderer
 #define VISUAL_FLAG_COLOR_BACKGROUND 0
 #define VISUAL_FLAG_COLOR_TEXT 1
@@ -104,6 +109,7 @@ struct visual_info {
   file_offset_t displacement; // Offset to begin of first character
   file_offset_t rewind;     // Relative offset (backwards) to begin of the last keyword/character
   int dirty;                // Mark page as dirty (not completely rendered yet)
+  int ascii;                // Page contains printable ASCII, tabs and line feeds only (checked once per content)
   struct visual_bracket brackets[VISUAL_BRACKET_MAX]; // Bracket depth
   struct visual_bracket brackets_line[VISUAL_BRACKET_MAX]; // Bracket depth of line
 };